@@ -0,0 +1,197 @@
+-- lcd_fb.vhd : znakova pamet displeje 2x16 s vlastnim obnovovanim radice HD44780
+--
+-- Registry (ADDR):
+--   0 - zapis nastavi pozici znaku 0 az 31 (radek * 16 + sloupec)
+--   1 - zapis ulozi dva znaky (bity 15..8 na pozici, bity 7..0 na pozici + 1),
+--       pozice se posune o 2, za poslednim znakem se vrati na 0
+--
+-- MCU tedy cely displej prepise jedinym prenosem 16 slov a po nem je pozice opet 0.
+-- Registr 1 je v top_level.vhd dekodovan na celem okne za registrem 0, takze prenos
+-- zustane ve znakove pameti i pri adrese zvysovane po kazdem slove.
+-- Po resetu se displej inicializuje (8bitova sbernice, 2 radky, bez kurzoru).
+-- Po kazdem zapisu do znakove pameti se displej obnovi: adresa radku a 16 znaku
+-- pro kazdy radek, zapisy nasleduji po T_CMD taktech (doba provedeni prikazu HD44780),
+-- MCU tedy casovani displeje neresi. Zapis v prubehu obnovy vyvola dalsi obnovu.
+--
+
+library IEEE;
+use ieee.std_logic_1164.ALL;
+use ieee.std_logic_ARITH.ALL;
+use ieee.std_logic_UNSIGNED.ALL;
+
+entity lcd_fb is
+   port (
+      CLK      : in  std_logic; -- 7,3728 MHz
+      RST      : in  std_logic;
+
+      -- zapis z SPI_adc
+      ADDR     : in  std_logic_vector(0 downto 0);
+      DATA_IN  : in  std_logic_vector(15 downto 0);
+      WRITE_EN : in  std_logic;
+
+      -- signaly displeje
+      DISPLAY_RS   : out   std_logic;
+      DISPLAY_DATA : inout std_logic_vector(7 downto 0);
+      DISPLAY_RW   : out   std_logic;
+      DISPLAY_EN   : out   std_logic
+   );
+end lcd_fb;
+
+architecture behavioral of lcd_fb is
+   -- casy v taktech CLK
+   constant T_POWER : integer := 147456; -- 20 ms po zapnuti napajeni
+   constant T_INIT  : integer := 36864;  -- 5 ms mezi prikazy inicializace
+   constant T_CLEAR : integer := 16384;  -- 2,2 ms pro smazani displeje
+   constant T_CMD   : integer := 512;    -- 69 us pro zapis znaku nebo adresy
+   constant T_EN    : integer := 4;      -- 540 ns sirka pulzu EN
+
+   -- inicializace: 3x function set (8 bitu, 2 radky), displej zapnut, posun adresy doprava, smazani
+   type t_init is array (0 to 5) of std_logic_vector(7 downto 0);
+   constant INIT : t_init := (X"38", X"38", X"38", X"0C", X"06", X"01");
+
+   type t_fb is array (0 to 31) of std_logic_vector(7 downto 0);
+   signal fb     : t_fb := (others => X"20");
+   signal fb_pos : std_logic_vector(4 downto 0);
+   signal dirty  : std_logic;
+
+   type t_state is (S_POWER, S_INIT, S_IDLE, S_LINE, S_CHAR, S_EN, S_WAIT);
+   signal state    : t_state;
+   signal next_st  : t_state;                      -- stav po zapisu a cekani
+   signal timer    : integer range 0 to T_POWER;
+   signal init_idx : integer range 0 to 5;
+   signal line     : std_logic;                    -- obnovovany radek
+   signal col      : std_logic_vector(3 downto 0); -- obnovovany sloupec
+   signal lcd_rs   : std_logic;
+   signal lcd_data : std_logic_vector(7 downto 0);
+   signal lcd_en   : std_logic;
+   signal clear_dirty : std_logic;
+
+begin
+
+   -- znakova pamet zapisovana z MCU
+   regs: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         if (RST = '1') then
+            fb_pos <= (others => '0');
+            dirty  <= '1';
+         else
+            if (clear_dirty = '1') then
+               dirty <= '0';
+            end if;
+            if (WRITE_EN = '1') then
+               if (ADDR = "0") then
+                  fb_pos <= DATA_IN(4 downto 0);
+               else
+                  fb(conv_integer(fb_pos))     <= DATA_IN(15 downto 8);
+                  fb(conv_integer(fb_pos + 1)) <= DATA_IN(7 downto 0);
+                  fb_pos <= fb_pos + 2;
+                  dirty  <= '1';
+               end if;
+            end if;
+         end if;
+      end if;
+   end process;
+
+   -- inicializace a obnovovani displeje
+   refresh: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         clear_dirty <= '0';
+         if (RST = '1') then
+            state    <= S_POWER;
+            timer    <= T_POWER;
+            init_idx <= 0;
+            lcd_en   <= '0';
+            lcd_rs   <= '0';
+            lcd_data <= (others => '0');
+         else
+            case state is
+               when S_POWER =>
+                  if (timer = 0) then
+                     state <= S_INIT;
+                  else
+                     timer <= timer - 1;
+                  end if;
+
+               -- prikazy inicializace
+               when S_INIT =>
+                  lcd_rs   <= '0';
+                  lcd_data <= INIT(init_idx);
+                  lcd_en   <= '1';
+                  timer    <= T_EN;
+                  state    <= S_EN;
+                  if (init_idx = 5) then
+                     next_st <= S_IDLE;
+                  else
+                     init_idx <= init_idx + 1;
+                     next_st  <= S_INIT;
+                  end if;
+
+               -- cekani na zmenu znakove pameti
+               when S_IDLE =>
+                  if (dirty = '1') then
+                     clear_dirty <= '1';
+                     line  <= '0';
+                     state <= S_LINE;
+                  end if;
+
+               -- adresa zacatku radku v DDRAM (0x00 nebo 0x40)
+               when S_LINE =>
+                  lcd_rs   <= '0';
+                  lcd_data <= '1' & line & "000000";
+                  lcd_en   <= '1';
+                  col      <= (others => '0');
+                  timer    <= T_EN;
+                  state    <= S_EN;
+                  next_st  <= S_CHAR;
+
+               when S_CHAR =>
+                  lcd_rs   <= '1';
+                  lcd_data <= fb(conv_integer(line & col));
+                  lcd_en   <= '1';
+                  timer    <= T_EN;
+                  state    <= S_EN;
+                  col      <= col + 1;
+                  if (col /= "1111") then
+                     next_st <= S_CHAR;
+                  elsif (line = '0') then
+                     line    <= '1';
+                     next_st <= S_LINE;
+                  else
+                     next_st <= S_IDLE;
+                  end if;
+
+               -- pulz EN, data se zapisi sestupnou hranou
+               when S_EN =>
+                  if (timer = 0) then
+                     lcd_en <= '0';
+                     if (next_st = S_INIT) then
+                        timer <= T_INIT;
+                     elsif (lcd_rs = '0') and (lcd_data = X"01") then
+                        timer <= T_CLEAR;
+                     else
+                        timer <= T_CMD;
+                     end if;
+                     state <= S_WAIT;
+                  else
+                     timer <= timer - 1;
+                  end if;
+
+               when S_WAIT =>
+                  if (timer = 0) then
+                     state <= next_st;
+                  else
+                     timer <= timer - 1;
+                  end if;
+            end case;
+         end if;
+      end if;
+   end process;
+
+   DISPLAY_RS   <= lcd_rs;
+   DISPLAY_DATA <= lcd_data;
+   DISPLAY_RW   <= '0'; -- do displeje se pouze zapisuje
+   DISPLAY_EN   <= lcd_en;
+
+end behavioral;
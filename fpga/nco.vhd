@@ -0,0 +1,88 @@
+-- nco.vhd : numericky rizeny oscilator se sigma-delta vystupem
+--
+-- Registry (ADDR):
+--   0 - prirustek faze, bity 15..0 (ulozi se do stinoveho registru)
+--   1 - prirustek faze, bity 31..16 (zapisem se pouzije cely 32-bitovy prirustek)
+--   2 - hlasitost, bity 7..0 (0 = ticho)
+--
+-- Faze se pricita kazdy takt CLK, f = INC * f_CLK / 2^32. Hornich 5 bitu faze
+-- adresuje tabulku 32 vzorku sinu, vzorek se nasobi hlasitosti a vystup
+-- prvniho radu sigma-delta modulatoru staci vyfiltrovat RC clenem.
+--
+
+library IEEE;
+use ieee.std_logic_1164.ALL;
+use ieee.std_logic_ARITH.ALL;
+use ieee.std_logic_UNSIGNED.ALL;
+
+entity nco is
+   port (
+      CLK      : in  std_logic;
+      RST      : in  std_logic;
+
+      -- zapis registru z SPI_adc
+      ADDR     : in  std_logic_vector(1 downto 0);
+      DATA_IN  : in  std_logic_vector(15 downto 0);
+      WRITE_EN : in  std_logic;
+
+      -- jednobitovy vystup sigma-delta modulatoru
+      DAC_OUT  : out std_logic
+   );
+end nco;
+
+architecture behavioral of nco is
+   type t_wave is array (0 to 31) of std_logic_vector(7 downto 0);
+   constant WAVE : t_wave := (
+      X"80", X"98", X"B0", X"C6", X"DA", X"EA", X"F5", X"FD",
+      X"FF", X"FD", X"F5", X"EA", X"DA", X"C6", X"B0", X"98",
+      X"80", X"67", X"4F", X"39", X"25", X"15", X"0A", X"02",
+      X"00", X"02", X"0A", X"15", X"25", X"39", X"4F", X"67"
+   );
+
+   signal inc_low : std_logic_vector(15 downto 0); -- stinovy registr dolni poloviny prirustku
+   signal inc     : std_logic_vector(31 downto 0);
+   signal volume  : std_logic_vector(7 downto 0);
+   signal phase   : std_logic_vector(31 downto 0);
+   signal sample  : std_logic_vector(15 downto 0); -- vzorek vynasobeny hlasitosti
+   signal sd_acc  : std_logic_vector(8 downto 0);  -- akumulator sigma-delta modulatoru
+
+begin
+
+   -- registry zapisovane z MCU
+   regs: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         if (RST = '1') then
+            inc_low <= (others => '0');
+            inc     <= (others => '0');
+            volume  <= (others => '0');
+         elsif (WRITE_EN = '1') then
+            case ADDR is
+               when "00"   => inc_low <= DATA_IN;
+               when "01"   => inc <= DATA_IN & inc_low;
+               when "10"   => volume <= DATA_IN(7 downto 0);
+               when others => null;
+            end case;
+         end if;
+      end if;
+   end process;
+
+   -- fazovy akumulator, tabulka vzorku a sigma-delta modulator
+   osc: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         if (RST = '1') then
+            phase  <= (others => '0');
+            sample <= (others => '0');
+            sd_acc <= (others => '0');
+         else
+            phase  <= phase + inc;
+            sample <= WAVE(conv_integer(phase(31 downto 27))) * volume;
+            sd_acc <= ('0' & sd_acc(7 downto 0)) + ('0' & sample(15 downto 8));
+         end if;
+      end if;
+   end process;
+
+   DAC_OUT <= sd_acc(8);
+
+end behavioral;
@@ -0,0 +1,181 @@
+-- nco_tb.vhd : testbench NCO - kmitocet a amplituda vystupu podle registru INC a hlasitosti
+--
+-- Registry se zapisuji primo na vstup nco (ADDR 0 az 2 odpovida adresam SPI 0x10 az 0x12,
+-- NCO_ADDR_* v mcu/main.c). Jednobitovy vystup sigma-delta se filtruje klouzavym souctem
+-- poslednich FILT taktu (pocet jednicek odpovida vzorku * hlasitost), perioda se pocita
+-- prechody filtrovaneho signalu pres stred s hysterezi v okne WINDOW taktu.
+-- Pro kazdou kombinaci INC a hlasitosti se overi:
+--   - pocet period v okne = WINDOW * INC / 2^32 (+-1 perioda na zacatku a konci okna)
+--   - rozkmit filtrovaneho signalu = FILT * (255 * hlasitost / 256) / 256 (+-AMP_TOL)
+-- Dale se overi, ze zapis samotne dolni poloviny INC kmitocet nezmeni a ze hlasitost 0 je ticho.
+--
+-- Spusteni (GHDL):
+--   ghdl -a fpga/nco.vhd fpga/nco_tb.vhd
+--   ghdl -e nco_tb
+--   ghdl -r nco_tb
+--
+
+library IEEE;
+use ieee.std_logic_1164.ALL;
+use ieee.std_logic_ARITH.ALL;
+use ieee.std_logic_UNSIGNED.ALL;
+
+entity nco_tb is
+end nco_tb;
+
+architecture behavioral of nco_tb is
+   constant T_CLK   : time := 135633 ps; -- 7,3728 MHz
+   constant FILT    : integer := 64;     -- delka klouzaveho souctu v taktech
+   constant WINDOW  : integer := 65536;  -- okno mereni v taktech
+   constant SETTLE  : integer := 4096;   -- ustaleni po zmene registru
+   constant HYST    : integer := 4;      -- hystereze detektoru prechodu
+   constant AMP_TOL : integer := 3;      -- tolerance rozkmitu (zaokrouhleni tabulky a sigma-delta)
+
+   signal clk      : std_logic := '0';
+   signal rst      : std_logic := '1';
+   signal addr     : std_logic_vector(1 downto 0) := (others => '0');
+   signal data_in  : std_logic_vector(15 downto 0) := (others => '0');
+   signal write_en : std_logic := '0';
+   signal dac_out  : std_logic;
+   signal done     : boolean := false;
+
+begin
+
+   uut: entity work.nco
+      port map (
+         CLK      => clk,
+         RST      => rst,
+         ADDR     => addr,
+         DATA_IN  => data_in,
+         WRITE_EN => write_en,
+         DAC_OUT  => dac_out
+      );
+
+   clk <= not clk after T_CLK / 2 when not done else '0';
+
+   test: process
+      type t_hist is array (0 to FILT - 1) of std_logic;
+
+      -- zapis registru NCO jednim taktem WRITE_EN
+      procedure reg_write(a : in integer; d : in std_logic_vector(15 downto 0)) is
+      begin
+         wait until falling_edge(clk);
+         addr     <= conv_std_logic_vector(a, 2);
+         data_in  <= d;
+         write_en <= '1';
+         wait until falling_edge(clk);
+         write_en <= '0';
+      end procedure;
+
+      -- prirustek faze: dolni polovina do stinoveho registru, horni polovina zapise cely INC
+      procedure set_inc(inc : in std_logic_vector(31 downto 0)) is
+      begin
+         reg_write(0, inc(15 downto 0));
+         reg_write(1, inc(31 downto 16));
+      end procedure;
+
+      -- mereni poctu period a minima a maxima filtrovaneho vystupu v okne WINDOW taktu
+      procedure measure(periods : out integer; lo : out integer; hi : out integer) is
+         variable hist  : t_hist := (others => '0');
+         variable pos   : integer := 0;
+         variable sum   : integer := 0;
+         variable mid   : integer;
+         variable high  : boolean := false;
+         variable n, mn, mx : integer;
+      begin
+         -- naplneni filtru a urceni stredu z rozkmitu za ustaleni
+         mn := FILT;
+         mx := 0;
+         for i in 0 to SETTLE - 1 loop
+            wait until rising_edge(clk);
+            if (hist(pos) = '1') then sum := sum - 1; end if;
+            hist(pos) := dac_out;
+            if (dac_out = '1') then sum := sum + 1; end if;
+            pos := (pos + 1) mod FILT;
+            if (i >= FILT) then
+               if (sum < mn) then mn := sum; end if;
+               if (sum > mx) then mx := sum; end if;
+            end if;
+         end loop;
+         mid  := (mn + mx) / 2;
+         high := sum > mid;
+
+         n  := 0;
+         mn := FILT;
+         mx := 0;
+         for i in 0 to WINDOW - 1 loop
+            wait until rising_edge(clk);
+            if (hist(pos) = '1') then sum := sum - 1; end if;
+            hist(pos) := dac_out;
+            if (dac_out = '1') then sum := sum + 1; end if;
+            pos := (pos + 1) mod FILT;
+            if (sum < mn) then mn := sum; end if;
+            if (sum > mx) then mx := sum; end if;
+            if ((not high) and (sum > mid + HYST)) then
+               high := true;
+               n    := n + 1;
+            elsif (high and (sum < mid - HYST)) then
+               high := false;
+            end if;
+         end loop;
+         periods := n;
+         lo      := mn;
+         hi      := mx;
+      end procedure;
+
+      -- overeni kmitoctu a rozkmitu pro prirustek 2^32 / period_clk a hlasitost vol
+      procedure check(period_clk : in integer; vol : in integer) is
+         variable periods, lo, hi : integer;
+         variable expect_n, expect_amp : integer;
+      begin
+         set_inc(conv_std_logic_vector(2 ** 30 / (period_clk / 4), 32));
+         reg_write(2, conv_std_logic_vector(vol, 16));
+         measure(periods, lo, hi);
+         expect_n   := WINDOW / period_clk;
+         expect_amp := FILT * ((255 * vol) / 256) / 256;
+         assert abs (periods - expect_n) <= 1
+            report "perioda " & integer'image(period_clk) & " taktu: namereno " & integer'image(periods) &
+                   " period, ocekavano " & integer'image(expect_n)
+            severity error;
+         assert abs ((hi - lo) - expect_amp) <= AMP_TOL
+            report "hlasitost " & integer'image(vol) & ": rozkmit " & integer'image(hi - lo) &
+                   ", ocekavano " & integer'image(expect_amp)
+            severity error;
+         report "INC pro periodu " & integer'image(period_clk) & " taktu, hlasitost " & integer'image(vol) &
+                ": " & integer'image(periods) & " period, rozkmit " & integer'image(hi - lo);
+      end procedure;
+
+      variable periods, lo, hi : integer;
+
+   begin
+      wait for 4 * T_CLK;
+      wait until falling_edge(clk);
+      rst <= '0';
+
+      -- kmitocet podle INC (f = INC * f_CLK / 2^32) a amplituda podle hlasitosti
+      check(1024, 255);
+      check(4096, 255);
+      check(512, 255);
+      check(1024, 128);
+      check(1024, 64);
+
+      -- zapis dolni poloviny INC se projevi az se zapisem horni poloviny
+      -- (INC = 0x0000FFFF by dal v okne 0 period)
+      reg_write(0, X"FFFF");
+      measure(periods, lo, hi);
+      assert abs (periods - WINDOW / 1024) <= 1
+         report "zapis dolni poloviny INC zmenil kmitocet: " & integer'image(periods) & " period"
+         severity error;
+
+      -- hlasitost 0 je ticho
+      reg_write(2, X"0000");
+      measure(periods, lo, hi);
+      assert (hi = 0) and (periods = 0)
+         report "hlasitost 0: vystup neni v klidu" severity error;
+
+      report "nco_tb: konec testu";
+      done <= true;
+      wait;
+   end process;
+
+end behavioral;
@@ -0,0 +1,80 @@
+-- song_ram.vhd : pamet skladeb a vzorku v blokove RAM s automatickym posunem adresy
+--
+-- Registry (ADDR):
+--   0 - zapis nastavi adresu slova (ukazatel), cteni vrati ukazatel
+--   1 - cteni vrati slovo na adrese ukazatele, zapis ulozi slovo na adresu ukazatele,
+--       po kazdem slove se ukazatel posune o 1 (za posledni slovo pameti se vrati na 0)
+--
+-- SPI_adc pri jednom vyberu obvodu (CS) prenasi libovolny pocet slov za adresou,
+-- MCU tedy po nastaveni ukazatele cte nebo zapisuje blok slov jedinym prenosem.
+-- Registr 1 je v top_level.vhd dekodovan na celem okne za registrem 0, takze prenos
+-- zustane v pameti i pri adrese zvysovane po kazdem slove.
+-- Slovo pro cteni je pripraveno takt po zmene ukazatele, SPI_adc ho prevezme
+-- spolu s READ_EN a ukazatel se posune ve stejnem taktu.
+--
+
+library IEEE;
+use ieee.std_logic_1164.ALL;
+use ieee.std_logic_ARITH.ALL;
+use ieee.std_logic_UNSIGNED.ALL;
+
+entity song_ram is
+   generic (
+      ADDR_BITS : integer := 10 -- 1024 slov = 2 KB, jedna blokova RAM
+   );
+   port (
+      CLK      : in  std_logic;
+      RST      : in  std_logic;
+
+      -- pristup z SPI_adc
+      ADDR     : in  std_logic_vector(0 downto 0);
+      DATA_IN  : in  std_logic_vector(15 downto 0);
+      DATA_OUT : out std_logic_vector(15 downto 0);
+      WRITE_EN : in  std_logic;
+      READ_EN  : in  std_logic
+   );
+end song_ram;
+
+architecture behavioral of song_ram is
+   type t_mem is array (0 to 2**ADDR_BITS-1) of std_logic_vector(15 downto 0);
+   signal mem : t_mem;
+
+   signal ptr   : std_logic_vector(ADDR_BITS-1 downto 0);
+   signal ram_q : std_logic_vector(15 downto 0); -- slovo na adrese ukazatele
+   signal ptr_out : std_logic_vector(15 downto 0);
+
+begin
+
+   -- ukazatel a zapis do pameti
+   regs: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         if (RST = '1') then
+            ptr <= (others => '0');
+         elsif (WRITE_EN = '1') then
+            if (ADDR = "0") then
+               ptr <= DATA_IN(ADDR_BITS-1 downto 0);
+            else
+               mem(conv_integer(ptr)) <= DATA_IN;
+               ptr <= ptr + 1;
+            end if;
+         elsif (READ_EN = '1') and (ADDR = "1") then
+            ptr <= ptr + 1;
+         end if;
+      end if;
+   end process;
+
+   -- synchronni cteni (blokova RAM), slovo odpovida ukazateli z predchoziho taktu
+   rd: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         ram_q <= mem(conv_integer(ptr));
+      end if;
+   end process;
+
+   ptr_out(15 downto ADDR_BITS) <= (others => '0');
+   ptr_out(ADDR_BITS-1 downto 0) <= ptr;
+
+   DATA_OUT <= ptr_out when ADDR = "0" else ram_q;
+
+end behavioral;
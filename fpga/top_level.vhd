@@ -54,8 +54,37 @@ architecture main of tlv_bare_ifc is
 
    -- Keyboard 4x4
    signal key_data_in : std_logic_vector (15 downto 0);
+   signal key_vld     : std_logic;
+   signal key_addr    : std_logic_vector(0 downto 0);
+   signal key_read_en : std_logic;
+   signal key_spi_out : std_logic_vector (15 downto 0);
+
+   -- FIFO udalosti klavesnice, kazda polozka je novy stav vsetkych 16 klaves
+   constant KEY_FIFO_DEPTH : integer := 8;
+   type t_key_fifo is array (0 to KEY_FIFO_DEPTH-1) of std_logic_vector(15 downto 0);
+   signal key_fifo     : t_key_fifo;
+   signal key_fifo_wr  : integer range 0 to KEY_FIFO_DEPTH-1;
+   signal key_fifo_rd  : integer range 0 to KEY_FIFO_DEPTH-1;
+   signal key_fifo_cnt : integer range 0 to KEY_FIFO_DEPTH;
+   signal key_state    : std_logic_vector (15 downto 0); -- posledny stav zapisany do FIFO
+   signal key_push     : std_logic;
+   signal key_pop      : std_logic;
+
+   -- NCO
+   signal nco_addr     : std_logic_vector(1 downto 0);
+   signal nco_data     : std_logic_vector(15 downto 0);
+   signal nco_write_en : std_logic;
+
+   -- pamet skladeb
+   signal song_spi_addr : std_logic_vector(4 downto 0);
+   signal song_addr     : std_logic_vector(0 downto 0);
+   signal song_data_in  : std_logic_vector(15 downto 0);
+   signal song_data_out : std_logic_vector(15 downto 0);
+   signal song_write_en : std_logic;
+   signal song_read_en  : std_logic;
 
    -- displej
+   signal dis_spi_addr : std_logic_vector(4 downto 0);
    signal dis_addr     : std_logic_vector(0 downto 0);
    signal dis_data_out : std_logic_vector(15 downto 0);
    signal dis_write_en : std_logic;
@@ -102,13 +131,43 @@ architecture main of tlv_bare_ifc is
       );
    end component;
 
-   component lcd_raw_controller
+   component nco
       port (
-         RST      : in std_logic;
-         CLK      : in std_logic;
+         CLK      : in  std_logic;
+         RST      : in  std_logic;
+
+         ADDR     : in  std_logic_vector(1 downto 0);
+         DATA_IN  : in  std_logic_vector(15 downto 0);
+         WRITE_EN : in  std_logic;
+
+         DAC_OUT  : out std_logic
+      );
+   end component;
+
+   component song_ram
+      generic (
+         ADDR_BITS : integer
+      );
+      port (
+         CLK      : in  std_logic;
+         RST      : in  std_logic;
+
+         ADDR     : in  std_logic_vector(0 downto 0);
+         DATA_IN  : in  std_logic_vector(15 downto 0);
+         DATA_OUT : out std_logic_vector(15 downto 0);
+         WRITE_EN : in  std_logic;
+         READ_EN  : in  std_logic
+      );
+   end component;
+
+   component lcd_fb
+      port (
+         CLK      : in  std_logic;
+         RST      : in  std_logic;
 
-         DATA_IN  : in std_logic_vector (15 downto 0);
-         WRITE_EN : in std_logic;
+         ADDR     : in  std_logic_vector(0 downto 0);
+         DATA_IN  : in  std_logic_vector(15 downto 0);
+         WRITE_EN : in  std_logic;
 
          DISPLAY_RS   : out   std_logic;
          DISPLAY_DATA : inout std_logic_vector(7 downto 0);
@@ -121,13 +180,15 @@ begin
 
    LEDF  <= '0';
 
-   -- Adresovy dekoder
+   -- Adresovy dekoder klavesnice
+   -- 0x02 - cteni vybere nejstarsi udalost z FIFO
+   -- 0x03 - cteni vrati aktualni stav klaves (FIFO se nemeni)
    SPI_adc_keybrd: SPI_adc
       generic map(
          ADDR_WIDTH => 8,       -- sirka adresy 8 bitu
          DATA_WIDTH => 16,      -- sirka dat 16 bitu
          ADDR_OUT_WIDTH => 1,   -- sirka adresy na vystupu min. 1 bit
-         BASE_ADDR  => 16#0002# -- adresovy prostor od 0x0002
+         BASE_ADDR  => 16#0002# -- adresovy prostor od 0x0002-0x0003
       )
       port map(
          CLK   =>  CLK,
@@ -138,12 +199,14 @@ begin
          DI       => SPI_DI,
          DI_REQ   => SPI_DI_REQ,
    
-         ADDR     => open,
+         ADDR     => key_addr,
          DATA_OUT => open,
-         DATA_IN  => key_data_in,
+         DATA_IN  => key_spi_out,
          WRITE_EN => open,
-         READ_EN  => open
+         READ_EN  => key_read_en
       );
+
+   key_spi_out <= key_fifo(key_fifo_rd) when key_addr = "0" else key_data_in;
      
    -- Radic klavesnice
    keybrd: keyboard_controller
@@ -152,20 +215,152 @@ begin
          RST      => RESET,       -- reset
          
          DATA_OUT => key_data_in,         
-         DATA_VLD => open,
+         DATA_VLD => key_vld,
 
          -- Keyboart
          KB_KIN   => KIN,
          KB_KOUT  => KOUT
       );
+
+   -- FIFO udalosti klavesnice
+   -- Kazda zmena stavu klaves se ulozi do FIFO, MCU cte udalosti pouze kdyz je FIFO neprazdne (IRQ = '1').
+   -- Pri plnem FIFO se zmena nezapise a stav se porovna znovu po dalsim skenovani klavesnice,
+   -- posledni stav klaves se tedy neztrati. Slovo je do SPI_adc prevzato spolu s READ_EN,
+   -- FIFO se proto posouva v tomtez taktu.
+   key_push <= '1' when (key_vld = '1') and (key_data_in /= key_state) and (key_fifo_cnt /= KEY_FIFO_DEPTH) else '0';
+   key_pop  <= '1' when (key_read_en = '1') and (key_addr = "0") and (key_fifo_cnt /= 0) else '0';
+
+   key_fifo_proc: process (CLK)
+   begin
+      if (CLK'event and CLK = '1') then
+         if (RESET = '1') then
+            key_fifo_wr  <= 0;
+            key_fifo_rd  <= 0;
+            key_fifo_cnt <= 0;
+            key_state    <= (others => '0');
+         else
+            if (key_push = '1') then
+               key_fifo(key_fifo_wr) <= key_data_in;
+               key_state <= key_data_in;
+               if (key_fifo_wr = KEY_FIFO_DEPTH-1) then
+                  key_fifo_wr <= 0;
+               else
+                  key_fifo_wr <= key_fifo_wr + 1;
+               end if;
+            end if;
+
+            if (key_pop = '1') then
+               if (key_fifo_rd = KEY_FIFO_DEPTH-1) then
+                  key_fifo_rd <= 0;
+               else
+                  key_fifo_rd <= key_fifo_rd + 1;
+               end if;
+            end if;
+
+            if (key_push = '1') and (key_pop = '0') then
+               key_fifo_cnt <= key_fifo_cnt + 1;
+            elsif (key_push = '0') and (key_pop = '1') then
+               key_fifo_cnt <= key_fifo_cnt - 1;
+            end if;
+         end if;
+      end if;
+   end process;
+
+   -- preruseni MCU, dokud FIFO obsahuje udalosti
+   IRQ <= '1' when key_fifo_cnt /= 0 else '0';
       
-   -- SPI dekoder pro displej
+   -- SPI dekoder pro NCO (registry viz nco.vhd)
+   SPI_adc_nco: SPI_adc
+      generic map(
+         ADDR_WIDTH => 8,       -- sirka adresy 8 bitu
+         DATA_WIDTH => 16,      -- sirka dat 16 bitu
+         ADDR_OUT_WIDTH => 2,   -- sirka adresy na vystupu 2 bity
+         BASE_ADDR  => 16#0010# -- adresovy prostor od 0x0010-0x0013
+      )
+      port map(
+         CLK      => CLK,
+
+         CS       => SPI_CS,
+         DO       => SPI_DO,
+         DO_VLD   => SPI_DO_VLD,
+         DI       => SPI_DI,
+         DI_REQ   => SPI_DI_REQ,
+
+         ADDR     => nco_addr,
+         DATA_OUT => nco_data,
+         DATA_IN  => "0000000000000000",
+         WRITE_EN => nco_write_en,
+         READ_EN  => open
+      );
+
+   -- numericky rizeny oscilator, sigma-delta vystup na X(0)
+   ncogen: nco
+      port map(
+         CLK      => CLK,
+         RST      => RESET,
+
+         ADDR     => nco_addr,
+         DATA_IN  => nco_data,
+         WRITE_EN => nco_write_en,
+
+         DAC_OUT  => X(0)
+      );
+
+   -- SPI dekoder pro pamet skladeb (registry viz song_ram.vhd)
+   -- 0x20 - ukazatel (adresa slova), 0x21 az 0x3F - data s automatickym posunem ukazatele
+   -- Datovy registr zabira cele okno, blokovy prenos od 0x21 tedy zustane v pameti skladeb
+   -- (az 31 slov), i kdyz SPI_adc po kazdem slove zvysi adresu.
+   SPI_adc_song: SPI_adc
+      generic map(
+         ADDR_WIDTH => 8,       -- sirka adresy 8 bitu
+         DATA_WIDTH => 16,      -- sirka dat 16 bitu
+         ADDR_OUT_WIDTH => 5,   -- sirka adresy na vystupu 5 bitu
+         BASE_ADDR  => 16#0020# -- adresovy prostor od 0x0020-0x003F
+      )
+      port map(
+         CLK      => CLK,
+
+         CS       => SPI_CS,
+         DO       => SPI_DO,
+         DO_VLD   => SPI_DO_VLD,
+         DI       => SPI_DI,
+         DI_REQ   => SPI_DI_REQ,
+
+         ADDR     => song_spi_addr,
+         DATA_OUT => song_data_in,
+         DATA_IN  => song_data_out,
+         WRITE_EN => song_write_en,
+         READ_EN  => song_read_en
+      );
+
+   song_addr <= "0" when song_spi_addr = "00000" else "1";
+
+   -- pamet skladeb a vzorku, 1024 slov v blokove RAM
+   songram: song_ram
+      generic map(
+         ADDR_BITS => 10
+      )
+      port map(
+         CLK      => CLK,
+         RST      => RESET,
+
+         ADDR     => song_addr,
+         DATA_IN  => song_data_in,
+         DATA_OUT => song_data_out,
+         WRITE_EN => song_write_en,
+         READ_EN  => song_read_en
+      );
+
+   -- SPI dekoder pro znakovou pamet displeje (registry viz lcd_fb.vhd)
+   -- 0x40 - pozice znaku, 0x41 az 0x5F - dva znaky s automatickym posunem pozice
+   -- Okno je oddelene od FIFO klavesnice (0x02), prenos celeho displeje (16 slov od 0x41)
+   -- tedy zustane ve znakove pameti, i kdyz SPI_adc po kazdem slove zvysi adresu.
    spidecd: SPI_adc
          generic map (
             ADDR_WIDTH => 8,     -- sirka adresy 8 bitu
             DATA_WIDTH => 16,    -- sirka dat 16 bitu
-            ADDR_OUT_WIDTH => 1, -- sirka adresy na vystupu 1 bit
-            BASE_ADDR  => 16#00# -- adresovy prostor od 0x00-0x01
+            ADDR_OUT_WIDTH => 5, -- sirka adresy na vystupu 5 bitu
+            BASE_ADDR  => 16#40# -- adresovy prostor od 0x40-0x5F
          )
          port map (
             CLK      => CLK,
@@ -176,7 +371,7 @@ begin
             DI       => SPI_DI,
             DI_REQ   => SPI_DI_REQ,
 
-            ADDR     => dis_addr,
+            ADDR     => dis_spi_addr,
             DATA_OUT => dis_data_out,
             DATA_IN  => "0000000000000000",
             WRITE_EN => dis_write_en,
@@ -184,13 +379,16 @@ begin
          );
 
   
-   -- radic LCD displeje
-   lcdctrl: lcd_raw_controller
+   dis_addr <= "0" when dis_spi_addr = "00000" else "1";
+
+   -- znakova pamet a obnovovani LCD displeje
+   lcdctrl: lcd_fb
          port map (
-            RST    =>  RESET,
             CLK    =>  CLK,
+            RST    =>  RESET,
 
             -- ridici signaly
+            ADDR     => dis_addr,
             DATA_IN  => dis_data_out,
             WRITE_EN => dis_write_en,
 
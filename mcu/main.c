@@ -4,1078 +4,3275 @@
  * @author Lukas Tkac (login: xtkacl00) <xtkacl00 AT stud.fit.vutbr.cz>
  */
 
+#include <stdint.h>
 #include <fitkitlib.h>
 #include <keyboard/keyboard.h>
-#include <lcd/display.h>
 
-/**
- * DEFINICIA FREKVENCII TONOV PRE 2 OKTAVY
- * Jednociarkova oktava c' d' e' f' g' a' h'
- * Dvojciarkova oktava c'' d'' e'' f'' g'' a'' h''
- *
- * Jednotlive frekvencie boli cerpane z tychto zdrojov:
- * 1) https://pages.mtu.edu/~suits/notefreqs.html
- * 2) http://radkon.eu/projects/other/tones.php?lang=sk
- * 
- * !!! POZOR 0 !!! vsetky frekvencie su nadefinovane v Hertzoch [Hz]
- * !!! POZOR 1 !!! v definiciach su pomenovane jednotlive tony medzinarodnou notaciou (napr. c' v medzinarodnej notacii je C4)
- * !!! POZOR 2 !!! nie je to "perfect tone" frekvencie zaokruhlene na cele cislo - desatinna cast zaokruhlena nahor
- * (napr 12.4Hz bude 13Hz)
- *
- */
+#include "wavetable.h"
+#include "songs.h"
 
 // definice kontrolnych stavov funkcii
 #define PROCESS_OK 0
 #define PROCESS_ERR 1
 
+// poradie tonov v oktave (pre vypocet MIDI cisla tonu)
+#define TONE_C  0
+#define TONE_CS 1  // cis / des
+#define TONE_D  2
+#define TONE_DS 3  // dis / es
+#define TONE_E  4
+#define TONE_F  5
+#define TONE_FS 6  // fis / ges
+#define TONE_G  7
+#define TONE_GS 8  // gis / as
+#define TONE_A  9
+#define TONE_AS 10 // ais / b
+#define TONE_B  11 // h
+
+// MIDI cislo tonu, napr. MIDI_NOTE(TONE_A, 4) = 69 (a' = 440 Hz)
+#define MIDI_NOTE(tone, octave) (((octave) + 1) * 12 + (tone))
+
+/**
+ * TONY OVLADANE KLAVESNICOU A TERMINALOM (MIDI cisla tonov)
+ * Jednociarkova oktava c' d' e' f' g' a' h'
+ * Dvojciarkova oktava c'' d'' e'' f'' g'' a'' h''
+ * v definiciach su pomenovane jednotlive tony medzinarodnou notaciou (napr. c' v medzinarodnej notacii je C4)
+ */
+
 // jednociarkova oktava
-#define C4 262 // c'
-#define D4 294 // d'
-#define E4 330 // e' 
-#define F4 350 // f'
-#define G4 392 // g'
-#define A4 440 // a'
-#define B4 494 // h'
+#define C4 MIDI_NOTE(TONE_C, 4) // c'
+#define D4 MIDI_NOTE(TONE_D, 4) // d'
+#define E4 MIDI_NOTE(TONE_E, 4) // e' 
+#define F4 MIDI_NOTE(TONE_F, 4) // f'
+#define G4 MIDI_NOTE(TONE_G, 4) // g'
+#define A4 MIDI_NOTE(TONE_A, 4) // a'
+#define B4 MIDI_NOTE(TONE_B, 4) // h'
 
 //dvojciarkova oktava
-#define C5 524 // c''
-#define D5 588 // d''
-#define E5 660 // e''
-#define F5 699 // f''
-#define G5 784 // g''
-#define A5 880 // a''
-#define B5 988 // h''
+#define C5 MIDI_NOTE(TONE_C, 5) // c''
+#define D5 MIDI_NOTE(TONE_D, 5) // d''
+#define E5 MIDI_NOTE(TONE_E, 5) // e''
+#define F5 MIDI_NOTE(TONE_F, 5) // f''
+#define G5 MIDI_NOTE(TONE_G, 5) // g''
+#define A5 MIDI_NOTE(TONE_A, 5) // a''
+#define B5 MIDI_NOTE(TONE_B, 5) // h''
+
+// rozsah tabulky tonov: C0 az B7 (8 oktav vratane poltonov)
+#define NOTE_FIRST MIDI_NOTE(TONE_C, 0)
+#define NOTE_LAST MIDI_NOTE(TONE_B, 7)
+#define NOTE_COUNT (NOTE_LAST - NOTE_FIRST + 1)
 
+/**
+ * FORMAT SKLADBY (bajtkod)
+ * Skladba je postupnost bajtov ulozena ako konstantne data vo flash pamati, ton zabera 1 bajt.
+ * 0nnnnnnn    - ton s MIDI cislom n, znie aktualnu dlzku tonu
+ * 10tttttt    - pauza dlha (t+1) tikov skladby
+ * 110ttttt    - dlzka nasledujucich tonov (t+1) tikov skladby
+ * 0xE0 lo hi  - dlzka tiku skladby v tikoch ACLK (16 bitov, little endian)
+ * 0xE1 n      - dlzka nasledujucich tonov n tikov skladby (1 az 255)
+ * 0xFF        - koniec skladby
+ */
+#define SONG_NOTE(tone, octave) MIDI_NOTE(tone, octave)
+#define SONG_REST(t) (0x80 | ((t) - 1))
+#define SONG_LEN(t) (0xC0 | ((t) - 1))
+#define SONG_CMD_TEMPO 0xE0
+#define SONG_CMD_LEN 0xE1
+#define SONG_TEMPO_MS(ms) SONG_CMD_TEMPO, (((ms) * 32768UL / 1000) & 0xFF), (((ms) * 32768UL / 1000) >> 8)
+#define SONG_END 0xFF
 
-// nezadefinovane noty pre demo  a potrebne pre DEMO skladbu 
-#define G3 196 // g0
-#define GS3 208 // gis0 /as0
-#define E3 165 // e0 
-#define A3 220 // a0
-#define AS3 234 // 	ais0 / b0
-#define B3 247 // b0
-#define FS4 370 // mozno Fs4 notaciu som nedohladal  tipujem to na FiS
-#define AB4 416 // gis' / as'
-#define BB4 467 // ais' / b'
-#define EB4 312 // dis'
+#define SONG_DEFAULT_TICK 4915 // 150 ms v tikoch ACLK
 
-#define EB5 623 // dis'' / es''
+// stavy sekvencera skladby
+#define SEQ_STOPPED 0
+#define SEQ_PLAYING 1
 
+// najdlhsie cakanie na jedno prerusenie CCR1 (polovica rozsahu casovaca)
+#define SEQ_MAX_WAIT 0x8000
 
+// zdroj bajtkodu pre sekvencer
+#define SEQ_SRC_FLASH 0 // skladba vo flash pamati (seq_pc)
+#define SEQ_SRC_QUEUE 1 // fronta v RAM plnena parserom melodie
 
-// pre generovanie tonu nastroja pouzijeme obdlznikove vzorky signalu
-#define SQUARE_SAMPLES 2  // pocet vzorku obdelnikoveho signalu
+// fronta bajtkodu v RAM, velkost musi byt mocnina 2
+#define SEQ_QUEUE_SIZE 64
+#define SEQ_QUEUE_MASK (SEQ_QUEUE_SIZE - 1)
+
+/**
+ * TABULKY VZORIEK NASTROJOV
+ * Kazdy nastroj ma vo flash pamati jednu periodu signalu po WAVE_SAMPLES 8-bitovych vzorkach
+ * pre kazdu oktavu (wavetable.h, generuje sim/wavegen.c). Tabulka oktavy obsahuje iba harmonicke
+ * pod polovicou vzorkovacej frekvencie pre najvyssi ton oktavy, takze vysoke tony nealiasuju
+ * a generator nepotrebuje ziadnu filtraciu. Tabulka sa vyberie pri spusteni tonu podla jeho oktavy.
+ */
+#define WAVE_SAMPLES 32 // pocet vzoriek periody signalu
+#define WAVE_BITS 5     // log2(WAVE_SAMPLES), pocet bitov fazy pouzitych ako index do tabulky vzoriek
+#define WAVE_OCTAVES 8  // tabulky pre oktavy 0 az 7
 
 // definicia poctu tikov za sekundu
 #define TICKS_PER_SECOND 32768 
 
-// definicia tvaru obdlznikoveho signalu
-unsigned char arr_square[SQUARE_SAMPLES] = {0, 255};
+/**
+ * DDS GENERATOR (fazovy akumulator)
+ * Vzorky sa generuju s pevnou vzorkovacou frekvenciou SAMPLE_RATE nezavisle od hraneho tonu.
+ * Pre kazdu vzorku sa k 32-bitovej faze pricita prirastok phase_inc = f * 2^32 / SAMPLE_RATE
+ * a najvyssie bity fazy urcuju index do tabulky vzorkov signalu.
+ * Rozlisenie frekvencie je SAMPLE_RATE / 2^32 (cca 2 uHz), ladenie tonu teda neovplyvnuje zaokruhlenie tikov.
+ */
+#if defined(AUDIO_PWM) && !defined(AUDIO_SMCLK)
+#define AUDIO_SMCLK // nosna PWM aj vzorkovanie bezia zo SMCLK (pozri PWM VYSTUP)
+#endif
+#ifndef AUDIO_SMCLK
+#define AUDIO_SAMPLE_TICKS 4 // perioda vzorkovania v tikoch ACLK
+#define SAMPLE_RATE (TICKS_PER_SECOND / AUDIO_SAMPLE_TICKS) // 8192 Hz
+#else
+#define SAMPLE_RATE 16384UL // nominalna vzorkovacia frekvencia, skutocnu urci delitel SMCLK
+#endif
+
+/**
+ * TAKT VZORKOVANIA ZO SMCLK (preklad s -DAUDIO_SMCLK)
+ * Z ACLK je mozne vzorkovat iba frekvenciou 32768 Hz / n. S AUDIO_SMCLK casovac B bezi zo SMCLK
+ * (vo FITkite krystal XT2 7,3728 MHz) a vzorkuje frekvenciou SAMPLE_RATE. Pri starte sa SMCLK zmeria
+ * zachytavanim ACLK z krystalu 32768 Hz do CCR2 casovaca A, ktory pocas merania bezi zo SMCLK
+ * (clock_measure). Ak SMCLK nebezi z XT2, DCO sa najprv doladi na AUDIO_SMCLK_HZ (dco_tune).
+ * Z nameraneho taktu sa urci delitel casovaca B a korekcia prirastkov fazy (audio_inc),
+ * ladenie tonov teda zodpoveda skutocnej vzorkovacej frekvencii s presnostou lepsou nez 1 cent.
+ */
+#define AUDIO_SMCLK_HZ 7372800UL // pozadovany SMCLK
+#define CAL_ACLK_PERIODS 256     // meranie SMCLK trva 256 period ACLK (7,8 ms, 57600 tikov SMCLK)
+#define CAL_COUNT_HZ (TICKS_PER_SECOND / CAL_ACLK_PERIODS) // prevod vysledku merania na Hz
+#define DCO_TUNE_PERIODS 8       // kratke meranie pri ladeni DCO (cca 0,06 % na tik)
+#define DCO_TUNE_TARGET ((unsigned int)(AUDIO_SMCLK_HZ * DCO_TUNE_PERIODS / TICKS_PER_SECOND))
+#define DCO_TUNE_STEPS 200       // najviac krokov ladenia DCO
+#define DCO_RSEL_MASK 0x07       // bity RSELx v BCSCTL1
+#define AUDIO_INC_ONE 0x8000     // audio_inc_scale pre presnu SAMPLE_RATE
+
+// prirastok fazy pre frekvenciu zadanu v mHz
+#define PHASE_INC_MHZ(mhz) ((unsigned long)((mhz) * (4294967296.0 / 1000.0 / SAMPLE_RATE) + 0.5))
+
+/**
+ * TABULKA TONOV
+ * Frekvencie tonov 8. oktavy v mHz podla rovnomerne temperovaneho ladenia (A4 = 440 Hz, f = 440 * 2^((n - 69) / 12)).
+ * Ton v oktave o ma frekvenciu f8 / 2^(8 - o), prirastky fazy vsetkych tonov su vypocitane prekladacom
+ * pre nastavenu SAMPLE_RATE, takze za behu sa ton vybera jedinym citanim z tabulky bez delenia.
+ */
+#define FREQ8_C  4186009.0
+#define FREQ8_CS 4434922.0
+#define FREQ8_D  4698636.0
+#define FREQ8_DS 4978032.0
+#define FREQ8_E  5274041.0
+#define FREQ8_F  5587652.0
+#define FREQ8_FS 5919911.0
+#define FREQ8_G  6271927.0
+#define FREQ8_GS 6644875.0
+#define FREQ8_A  7040000.0
+#define FREQ8_AS 7458620.0
+#define FREQ8_B  7902133.0
+
+#define NOTE_INC(f8, octave) PHASE_INC_MHZ((f8) / (1L << (8 - (octave))))
+#define OCTAVE_INC(octave) \
+    NOTE_INC(FREQ8_C, octave),  NOTE_INC(FREQ8_CS, octave), NOTE_INC(FREQ8_D, octave),  NOTE_INC(FREQ8_DS, octave), \
+    NOTE_INC(FREQ8_E, octave),  NOTE_INC(FREQ8_F, octave),  NOTE_INC(FREQ8_FS, octave), NOTE_INC(FREQ8_G, octave),  \
+    NOTE_INC(FREQ8_GS, octave), NOTE_INC(FREQ8_A, octave),  NOTE_INC(FREQ8_AS, octave), NOTE_INC(FREQ8_B, octave)
+
+/**
+ * HLASITOST
+ * Hlasitost ma VOLUME_STEPS urovni (0 = ticho, VOLUME_MAX = plna amplituda).
+ * Vzorka z tabulky sa nasobi urovnou hlasu (obalka a volume), obe su 8-bitove: nasobenie 8 x 8 bitov
+ * hardverovou nasobickou MSP430F168, prekladac okolo nej zakaze prerusenia, vnorene prerusenie ju
+ * teda nepokazi. Kopie tabuliek vynasobenych urovnou by usetrili nasobenie, ale zabrali by
+ * VOICES * WAVE_SAMPLES * 2 B RAM, ktore pri 2 kB RAM chybaju zasobniku vnorenych preruseni.
+ */
+#define VOLUME_STEPS 16
+#define VOLUME_MAX (VOLUME_STEPS - 1)
+
+/**
+ * HLASY (polyfonia)
+ * Kazdy hlas ma vlastny fazovy akumulator, prirastok fazy a hlasitost. Generator blokov vzoriek
+ * scita vzorky vsetkych VOICES hlasov, cas generovania teda rastie linearne s poctom hlasov
+ * a VOICES treba volit podla casoveho rozpoctu (pri 8192 Hz a MCLK 7,3728 MHz cca 900 cyklov na vzorku).
+ * DA prevodnik pracuje v 12-bitovom rezime, sucet hlasov sa posuva doprava o MIX_SHIFT a saturuje na DAC_MAX.
+ */
+#define VOICES 4
+#define VOICE_FREE 0xFF // hodnota note pre volny hlas
+#define MIX_SHIFT 2     // 4 hlasy s plnou hlasitostou (4 * 255 * 15 >> 2 = 3825) nesaturuju
+#define DAC_MAX 0x0FFF
+
+/**
+ * BLOKOVY VYSTUP VZORIEK (DMA)
+ * Vzorky sa generuju po blokoch AUDIO_BLOCK vzoriek do dvojice buffrov (ping-pong).
+ * Casovac B v rezime UP generuje s periodou AUDIO_SAMPLE_TICKS poziadavku TBCCR2 pre DMA kanal 0,
+ * ktory presuva vzorky z buffra do DAC12_0DAT bez ucasti CPU. Po odoslani celeho buffra pride
+ * prerusenie DMA, ktore prepne DMA na druhy buffer a do prave dohraneho buffra vygeneruje dalsi blok.
+ * Prerusenie teda prichadza raz za blok (cca 3,9 ms) namiesto raz za vzorku a vystup vzoriek
+ * nie je ovplyvneny dlzkou inych preruseni (displej, UART).
+ */
+#define AUDIO_BLOCK 32
+
+/**
+ * VYPINANIE ZVUKU V TICHU
+ * Ked ziaden hlas neznie a oba buffre su dohrane, zastavi sa casovac B, DMA, DA prevodnik
+ * aj referencne napatie. Prvy ton ich znova zapne, vystup sa spusti az po ustaleni reference
+ * (AUDIO_WARMUP_BLOCKS blokov ticha, cca 20 ms, reference potrebuje najviac 17 ms).
+ * Planovac uloh medzi ulohami spi (pozri PLANOVAC ULOH). Pocas zvuku sa spi v LPM0, lebo UART
+ * kniznice FITkit a DMA potrebuju SMCLK a MCLK. V tichu sa spi v LPM3, ked terminal SLEEP_TERM_IDLE_S
+ * sekund neprijal prikaz a neprebieha prijem melodie (STREAM). UART bez SMCLK neprijima, znaky
+ * poslane v LPM3 sa stratia, okno LPM0 znova otvori klavesa FITkitu alebo koniec zvuku. Vysielanie
+ * do LPM3 nezasahuje, kazdy vypis konci spolu s prikazom, ktory okno otvoril. Preklad s -DSLEEP_LPM0
+ * spi v tichu vzdy v LPM0 (terminal prijima vzdy).
+ */
+#ifndef AUDIO_PWM
+#define AUDIO_WARMUP_BLOCKS 5
+#else
+#define AUDIO_WARMUP_BLOCKS 0 // PWM referenciu nepotrebuje
+#endif
+#ifndef SLEEP_TERM_IDLE_S
+#define SLEEP_TERM_IDLE_S 10
+#endif
+#define SLEEP_TERM_IDLE_TICKS ((unsigned long)SLEEP_TERM_IDLE_S * TICKS_PER_SECOND)
+
+/**
+ * PWM VYSTUP (preklad s -DAUDIO_PWM)
+ * Namiesto DA prevodnika sa zvuk vystupuje sirkou impulzov na vyvode TB1 (P4.1) s nosnou PWM_RATE
+ * (32768 Hz, mimo pocutelneho pasma), staci RC clen alebo reproduktor s tranzistorom. Referencia
+ * ani DA prevodnik sa nezapinaju. Casovac B bezi zo SMCLK (AUDIO_SMCLK) s periodou nosnej, na kazdu
+ * vzorku pripada PWM_OVERSAMPLE period a DMA v kazdej periode zapise dlzku impulzu do TBCCR1
+ * (TBCL1 sa nacita pri TBR = 0, zmena teda nevyvola zakmit). Generator vzoriek sa nemeni: blok vzoriek
+ * v rozsahu DA prevodnika sa po vygenerovani prevedie na dlzky impulzov (pwm_convert).
+ * Perioda nosnej ma cca 225 tikov SMCLK (7,8 bitu). S -DAUDIO_PWM_NS sa chyba zaokruhlenia dlzky
+ * impulzu prenasa do dalsej periody (sigma-delta 1. radu), sum kvantovania sa tym presunie k nosnej
+ * a v pasme do 4 kHz je rozlisenie cca 10 bitov za cenu jedneho scitania na periodu.
+ */
+#ifdef AUDIO_PWM
+#define PWM_OVERSAMPLE 2                        // period PWM na jednu vzorku
+#define PWM_RATE (SAMPLE_RATE * PWM_OVERSAMPLE) // frekvencia nosnej PWM
+#define PWM_PIN BIT1                            // vystup TB1 na P4.1
+#define DAC_BITS 12                             // vzorky generatora su v rozsahu 12-bitoveho DA prevodnika
+#define AUDIO_OUT_BLOCK (AUDIO_BLOCK * PWM_OVERSAMPLE) // prenosov DMA na blok vzoriek
+#define AUDIO_OUT_REG TBCCR1
+#else
+#define AUDIO_OUT_BLOCK AUDIO_BLOCK
+#define AUDIO_OUT_REG DAC12_0DAT
+#endif
+
+/**
+ * NCO V FPGA (preklad s -DAUDIO_NCO)
+ * Ton generuje numericky rizeny oscilator v FPGA (fpga/nco.vhd) a MCU nepocita ziadne vzorky.
+ * Pri zmene tonu sa iba zapise prirastok fazy a hlasitost, znie najnovsi drzany ton (jednohlasne).
+ * Sekvencer meni tony v preruseni, SPI sa preto obsluhuje v hlavnej slucke (nco_idle).
+ * Vystup je na X(0) a staci ho vyfiltrovat RC clenom.
+ */
+#define FPGA_CLK 7372800UL                   // takt FPGA (f_CLK)
+#define NCO_INC_DIV (FPGA_CLK / SAMPLE_RATE) // prepocet prirastku DDS na takt FPGA (900, bez zvysku)
+#define NCO_ADDR_INC_LO 0x10                 // prirastok fazy, bity 15..0
+#define NCO_ADDR_INC_HI 0x11                 // prirastok fazy, bity 31..16 (zapis pouzije cely prirastok)
+#define NCO_ADDR_VOLUME 0x12                 // hlasitost 0 az 255
+
+/**
+ * PLANOVAC ULOH
+ * Hlavna slucka spusta ulohy, ktore bezia do dokoncenia a nikdy necakaju (dlhsia praca sa rozdeli
+ * na kroky, napr. parser melodie spracuje iba tolko znakov, kolko sa zmesti do fronty sekvencera).
+ * Uloha sa spusti v svojom termine alebo ked ju oznaci za pripravenu prerusenie ci ina uloha
+ * (task_signal). Periodicka uloha si po spusteni posunie termin o periodu, jednorazovej (perioda 0)
+ * nastavi termin task_at. Medzi ulohami CPU spi a CCR2 casovaca A sa nastavi na najblizsi termin,
+ * periodicky tik teda nie je. Poradie v tabulke uloh je ich priorita. Periodicky je iba terminal
+ * (kniznica FITkit prijem neohlasuje), ostatne ulohy bezia na signal, naprazdno sa CPU nebudi.
+ * Krok sekvencera (CCR1) a generovanie vzoriek s prepoctom obalky (DMA) zostavaju v preruseniach,
+ * lebo potrebuju presnost na tik ACLK a na vzorku.
+ */
+#define TASK_TICKS_MS(ms) ((unsigned int)((ms) * (unsigned long)TICKS_PER_SECOND / 1000))
+#define TASK_LEFT(deadline, now) (((deadline) - (now)) & 0xFFFF) // tiky do terminu (16-bitovy TAR)
+#define TASK_MIN_LEFT 2 // blizsi termin sa spusti hned, CCR2 by ho mohol minut
+
+// ulohy v poradi priority
+#define TASK_KEYBOARD 0  // udalosti klavesnice (na signal od prerusenia)
+#define TASK_NOTES_OFF 1 // ukoncenie tonov zadanych v terminali (jednorazova)
+#define TASK_TERMINAL 2  // terminal kniznice FITkit
+#define TASK_MELODY 3    // parser melodie zadanej prikazom PLAY (na signal)
+#define TASK_SONG_RAM 4  // citanie skladby z pamate skladieb v FPGA (na signal)
+#define TASK_LCD 5       // prenos tienovej pamate na displej (na signal pri zmene)
+#ifdef AUDIO_NCO
+#define TASK_NCO 6       // zapis tonu do NCO (na signal pri zmene hlasov)
+#define TASKS 7
+#else
+#define TASKS 6
+#endif
+
+typedef struct {
+    void (*run)(void);
+    unsigned int period;          // perioda v tikoch ACLK, 0 = jednorazova uloha
+    unsigned int deadline;        // TAR najblizsieho spustenia
+    unsigned char timed;          // termin deadline je platny
+    volatile unsigned char ready; // uloha je pripravena (task_signal)
+} task_t;
+
+/**
+ * STATISTIKY BEHU (prikaz STATS)
+ * Casy sa meraju rozdielom TAR casovaca A na zaciatku a konci useku (tiky ACLK, cca 30,5 us).
+ * Volny casovac zo SMCLK nie je (casovac B sa nuluje kazdu periodu vzorkovania), rozlisenie je teda
+ * 1 tik ACLK (225 tikov MCLK): kratky usek sa nameria ako 0 alebo 1 tik podla fazy ACLK, presny
+ * je az priemer z mnohych merani.
+ * Blok je nestihnuty, ak je po jeho vygenerovani DMAIFG uz znova nastaveny, teda DMA medzitym
+ * dohralo aj druhy buffer. Oneskorenie tonu sa meria zvlast pre klavesnicu, terminal a sekvencer
+ * od zadania tonu po zaciatok odosielania bloku s tonom do DA prevodnika; p50 a p99 sa urcia
+ * z histogramu, ktoreho interval je najviac 1/8 oneskorenia. Pri preklade s NDEBUG sa statistiky
+ * aj prikaz STATS vynechaju.
+ */
+#ifndef NDEBUG
+#define STATS
+#endif
+
+#ifdef STATS
+#define STATS_LAT_SUB 8    // intervalov histogramu oneskorenia v jednej skupine
+#define STATS_LAT_GROUPS 5 // skupiny so sirkou intervalu 8, 16, 32, 64 a 128 tikov ACLK (0 az 60 ms)
+#define STATS_LAT_BINS (STATS_LAT_SUB * STATS_LAT_GROUPS) // posledny interval zahrna aj dlhsie oneskorenia
+#define STATS_LAT_SHIFT 3  // log2 sirky intervalu prvej skupiny (8 tikov ACLK = 244 us)
+#define STATS_LAT_KEYBOARD 0  // klavesnica: od prerusenia IRQ z FPGA
+#define STATS_LAT_TERMINAL 1  // ton zadany v terminali: od spracovania riadku
+#define STATS_LAT_SEQUENCER 2 // ton skladby: od terminu kroku sekvencera (CCR1)
+#define STATS_LAT_PATHS 3
+#define TICKS_US(ticks) ((unsigned long)(ticks) * 1000000UL / TICKS_PER_SECOND)
+#define AUDIO_BLOCK_TICKS (AUDIO_BLOCK * TICKS_PER_SECOND / SAMPLE_RATE) // dlzka bloku v tikoch ACLK
+#define TAR_SINCE(start) ((TAR - (start)) & 0xFFFF) // tiky ACLK od casu start (16-bitovy TAR)
+
+typedef struct {
+    unsigned int min;    // najkratsi cas v tikoch ACLK
+    unsigned int max;    // najdlhsi cas
+    unsigned long sum;   // sucet casov pre priemer
+    unsigned long count; // pocet merani
+} stats_time_t;
+#endif
+
+/**
+ * OBALKA TONU (ADSR)
+ * Kazdy hlas ma obalku nabeh (attack) - pokles (decay) - drzanie (sustain) - doznievanie (release)
+ * v 16-bitovej pevnej desatinnej ciarke (0 az ENV_MAX). Obalka sa prepocitava raz za blok vzoriek,
+ * teda s riadiacou frekvenciou CONTROL_RATE, a jej uroven urcuje hlasitost hlasu pre cely blok.
+ * Rychlosti obalky su zmena urovne za jednu riadiacu periodu, parametre su ulozene v predvolbach nastrojov.
+ * Tabulky vzoriek su bez znamienka (0 az 255), hlas ma teda jednosmernu zlozku 128 * uroven, ktora
+ * sleduje obalku: nabeh 5 ms (organ, obdlznik) je na vystupe aj skok strednej hodnoty a je pocut
+ * ako tlmeny klik. Vzorky so znamienkom scitane okolo pevneho predpatia (stred DAC) by ju odstranili,
+ * ale ticho by potom nebolo 0 V: predpatie by skocilo pri kazdom zapnuti a vypnuti DA prevodnika
+ * (VYPINANIE ZVUKU V TICHU), teda pri prvom tone a po kazdej pauze. Skok pri nabehu je najviac
+ * 128 * uroven hlasu a trva cely nabeh, skok predpatia by bol polovica rozsahu DAC naraz.
+ */
+#define CONTROL_RATE (SAMPLE_RATE / AUDIO_BLOCK) // 256 Hz
+#define ENV_MAX 0xFFFF
+
+// rychlost, pri ktorej obalka prejde cely rozsah za ms milisekund
+#define ENV_RATE_MS(ms) ((unsigned int)(ENV_MAX / ((ms) * (unsigned long)CONTROL_RATE / 1000 + 1)))
+// uroven drzania v percentach plnej urovne
+#define ENV_LEVEL_PCT(pct) ((unsigned int)(ENV_MAX * (unsigned long)(pct) / 100))
+
+// stavy obalky hlasu
+#define ENV_IDLE 0    // hlas je volny
+#define ENV_ATTACK 1
+#define ENV_DECAY 2
+#define ENV_SUSTAIN 3
+#define ENV_RELEASE 4
+
+typedef struct {
+    char *name;            // nazov nastroja pre displej a terminal
+    const unsigned char (*waves)[WAVE_SAMPLES]; // tabulky vzoriek pre oktavy 0 az 7
+    unsigned int attack;   // rychlost nabehu
+    unsigned int decay;    // rychlost poklesu na uroven drzania
+    unsigned int sustain;  // uroven drzania
+    unsigned int release;  // rychlost doznievania po uvolneni tonu
+} instrument_t;
+
+#define INSTRUMENTS 4
+
+const instrument_t instruments[INSTRUMENTS] = {
+    {"Klarinet", wave_clarinet, ENV_RATE_MS(40), ENV_RATE_MS(150), ENV_LEVEL_PCT(80),  ENV_RATE_MS(60)},
+    {"Flauta",   wave_flute,    ENV_RATE_MS(90), ENV_RATE_MS(250), ENV_LEVEL_PCT(70),  ENV_RATE_MS(120)},
+    {"Organ",    wave_organ,    ENV_RATE_MS(5),  ENV_RATE_MS(5),   ENV_LEVEL_PCT(100), ENV_RATE_MS(10)},
+    {"Obdlznik", wave_square,   ENV_RATE_MS(5),  ENV_RATE_MS(100), ENV_LEVEL_PCT(70),  ENV_RATE_MS(30)}
+};
+
+unsigned char instrument = 0; // index predvolby nastroja pre nove tony
+
+/**
+ * PARAMETRE HLASU
+ * Tony spusta a ukoncuje hlavna slucka aj sekvencer, generator vzoriek ich preberie az na hranici
+ * bloku. Zapisovatel pripravi parametre do neplatnej polovice dvojiteho buffra param a az potom
+ * zvysi jednobajtove poradove cislo seq, ktore polovicu zverejni. Generator v preruseni DMA pred
+ * blokom porovna seq s naposledy prevzatym a pri zmene skopiruje platnu polovicu. Generator bezi
+ * s povolenymi preruseniami a sekvencer ho moze prerusit dvoma zverejneniami toho isteho hlasu
+ * (koniec tonu a novy ton), druhe prepise prave kopirovanu polovicu. Generator preto po skopirovani
+ * seq precita znova a pri zmene kopiruje znova, nikdy teda neprevezme rozpracovane parametre
+ * a zapis netreba chranit zakazom preruseni. Zapisovatelia (hlavna slucka a sekvencer) sa navzajom
+ * vylucuju maskovanim prerusenia CCR1 v note_on a note_off.
+ * Pri prevzati faza hlasu pokracuje a obalka nabieha od aktualnej urovne, zmena tonu teda nesposobi
+ * skok signalu ani skrateny prvy cyklus.
+ */
+typedef struct {
+    unsigned long phase_inc;    // prirastok fazy za jednu vzorku
+    const instrument_t *inst;   // predvolba nastroja
+    const unsigned char *wave;  // tabulka vzoriek nastroja pre oktavu tonu
+    unsigned char gate;         // 1 = ton je drzany (nabeh obalky), 0 = uvolneny (doznievanie)
+} voice_param_t;
+
+#define VOICE_PARAM(v) (&(v)->param[(v)->seq & 1]) // naposledy zverejnene parametre hlasu
+
+typedef struct {
+    // stav generatora, meni iba prerusenie DMA
+    unsigned long phase;        // faza generatora (cela perioda signalu = 2^32)
+    unsigned long phase_inc;    // prirastok fazy za jednu vzorku
+    const instrument_t *inst;   // predvolba nastroja, s ktorou bol ton spusteny
+    const unsigned char *wave;  // tabulka vzoriek hraneho tonu
+    unsigned int env_level;     // uroven obalky (0 az ENV_MAX)
+    volatile unsigned char env_state; // stav obalky, ENV_IDLE = tichy hlas
+    volatile unsigned char latched;   // seq naposledy prevzatych parametrov
+    // parametre zapisovatela (hlavna slucka alebo sekvencer)
+    voice_param_t param[2];     // dvojity buffer parametrov
+    volatile unsigned char seq; // poradove cislo zapisu, bit 0 je index platnej polovice param
+    unsigned char note;         // MIDI cislo posledneho spusteneho tonu alebo VOICE_FREE
+    unsigned int age;           // poradove cislo spustenia tonu, najmensie = najstarsi ton
+} voice_t;
+
+voice_t voices[VOICES];
+unsigned int voice_age = 0; // pocitadlo spustenych tonov
+
+unsigned char volume = VOLUME_MAX; // hlasitost hranych tonov, patri do intervalu <0,VOLUME_MAX>
+
+#ifdef STATS
+stats_time_t stats_render;        // generovanie bloku vzoriek v preruseni DMA
+stats_time_t stats_seq;           // krok sekvencera v preruseni CCR1
+unsigned int stats_missed;        // nestihnute bloky
+unsigned int stats_lat[STATS_LAT_PATHS][STATS_LAT_BINS]; // histogram oneskorenia od zadania tonu po jeho prvu vzorku v DAC
+unsigned int stats_lat_max[STATS_LAT_PATHS];   // najdlhsie oneskorenie v tikoch ACLK
+unsigned int stats_lat_stamp[STATS_LAT_PATHS]; // TAR pri zadani tonu
+unsigned char stats_lat_pending;  // bitova maska ciest, ktorych ton este nie je vygenerovany
+unsigned char stats_lat_rendered; // bitova maska ciest, ktorych ton je v bloku cakajucom na DMA
+unsigned int stats_key_stamp;     // TAR pri preruseni od klavesnice
+unsigned long stats_wakeups;      // prebudenia planovaca
+unsigned long stats_sleep;        // cas spanku hlavnej slucky v tikoch ACLK
+unsigned long stats_sleep_lpm3;   // z toho v LPM3
+unsigned long stats_start;        // sys_time pri vynulovani statistik
+unsigned int stats_task_resp[TASKS];  // najdlhsia odozva ulohy (od terminu alebo signalu po koniec behu)
+unsigned int stats_task_run[TASKS];   // najdlhsi beh ulohy
+unsigned int stats_task_count[TASKS]; // pocet spusteni ulohy
+unsigned int stats_task_stamp[TASKS]; // TAR pri signale ulohy
+#endif
+unsigned char nco_note = VOICE_FREE; // ton zapisany do NCO (VOICE_FREE = ticho)
+volatile unsigned char audio_on = 0;   // casovac B, DMA, DAC a reference su zapnute
+unsigned char audio_warmup;             // pocet blokov ticha do ustalenia reference
+unsigned char audio_silent;             // pocet po sebe iducich tichych blokov
+unsigned long sys_time = 0;             // cas behu v tikoch ACLK (aktualizuje planovac)
+unsigned long sleep_active = 0;         // sys_time posledneho prikazu terminalu, klavesy alebo zvuku
+unsigned int audio_buf[2][AUDIO_OUT_BLOCK]; // buffre vzoriek (pri PWM dlzok impulzov) pre DMA
+unsigned char audio_half = 0;           // index buffra, ktory prave odosiela DMA
+#ifdef AUDIO_SMCLK
+unsigned long audio_smclk;              // namerany SMCLK v Hz
+unsigned int audio_period;              // perioda vzorkovania v tikoch SMCLK
+unsigned int audio_inc_scale = AUDIO_INC_ONE; // korekcia prirastkov fazy SAMPLE_RATE / skutocna frekvencia (1.15)
+#endif
+#ifdef AUDIO_PWM
+unsigned int pwm_period;                // perioda nosnej PWM v tikoch SMCLK
+#ifdef AUDIO_PWM_NS
+unsigned int pwm_error;                 // chyba zaokruhlenia dlzky impulzu (DAC_BITS desatinnych bitov)
+#endif
+#endif
+
+// prirastky fazy tonov C0 az B7 indexovane MIDI cislom tonu - NOTE_FIRST
+const unsigned long note_inc_table[NOTE_COUNT] = {
+    OCTAVE_INC(0), OCTAVE_INC(1), OCTAVE_INC(2), OCTAVE_INC(3),
+    OCTAVE_INC(4), OCTAVE_INC(5), OCTAVE_INC(6), OCTAVE_INC(7)
+};
+
+// DEMO skladba v bajtkode sekvencera, tik skladby je 150 ms
+const unsigned char demo_song[] = {
+    SONG_TEMPO_MS(150),
+    SONG_LEN(1),
+    // 1. cast
+    SONG_NOTE(TONE_E, 4), SONG_NOTE(TONE_E, 4), SONG_REST(1), SONG_NOTE(TONE_E, 4),
+    SONG_NOTE(TONE_C, 4), SONG_NOTE(TONE_E, 4), SONG_REST(1), SONG_NOTE(TONE_G, 4),
+    SONG_REST(3), SONG_NOTE(TONE_G, 3), SONG_REST(3),
+    // 2. cast
+    SONG_NOTE(TONE_C, 4), SONG_REST(2), SONG_NOTE(TONE_G, 3), SONG_REST(2),
+    SONG_NOTE(TONE_E, 3), SONG_REST(2), SONG_NOTE(TONE_A, 3), SONG_REST(1),
+    SONG_NOTE(TONE_B, 3), SONG_REST(1), SONG_NOTE(TONE_AS, 3), SONG_NOTE(TONE_A, 3),
+    SONG_REST(1),
+    // 3. cast
+    SONG_NOTE(TONE_G, 3), SONG_NOTE(TONE_E, 4), SONG_REST(1), SONG_NOTE(TONE_G, 4),
+    SONG_NOTE(TONE_A, 4), SONG_REST(1), SONG_NOTE(TONE_F, 4), SONG_NOTE(TONE_G, 4),
+    SONG_REST(1), SONG_NOTE(TONE_E, 4), SONG_REST(1), SONG_NOTE(TONE_C, 4),
+    SONG_NOTE(TONE_D, 4), SONG_NOTE(TONE_B, 3), SONG_REST(2),
+    // 4. cast
+    SONG_REST(2), SONG_NOTE(TONE_G, 4), SONG_NOTE(TONE_FS, 4), SONG_NOTE(TONE_F, 4),
+    SONG_NOTE(TONE_DS, 4), SONG_REST(1), SONG_NOTE(TONE_E, 4), SONG_REST(1),
+    SONG_NOTE(TONE_GS, 3), SONG_NOTE(TONE_A, 3), SONG_NOTE(TONE_C, 4), SONG_REST(1),
+    SONG_NOTE(TONE_A, 3), SONG_NOTE(TONE_C, 4), SONG_NOTE(TONE_D, 4),
+    // 5. cast
+    SONG_REST(2), SONG_NOTE(TONE_G, 4), SONG_NOTE(TONE_FS, 4), SONG_NOTE(TONE_F, 4),
+    SONG_NOTE(TONE_DS, 4), SONG_REST(1), SONG_NOTE(TONE_E, 4), SONG_REST(1),
+    SONG_NOTE(TONE_C, 5), SONG_REST(1), SONG_NOTE(TONE_C, 5), SONG_NOTE(TONE_C, 5),
+    SONG_REST(3),
+    // 6. cast
+    SONG_REST(2), SONG_NOTE(TONE_DS, 4), SONG_REST(2), SONG_NOTE(TONE_D, 4),
+    SONG_REST(2), SONG_NOTE(TONE_C, 4), SONG_REST(7),
+    // 7. cast
+    SONG_NOTE(TONE_C, 4), SONG_NOTE(TONE_C, 4), SONG_REST(1), SONG_NOTE(TONE_C, 4),
+    SONG_REST(1), SONG_NOTE(TONE_C, 4), SONG_NOTE(TONE_D, 4), SONG_REST(1),
+    SONG_NOTE(TONE_E, 4), SONG_NOTE(TONE_C, 4), SONG_REST(1), SONG_NOTE(TONE_A, 3),
+    SONG_NOTE(TONE_G, 3), SONG_REST(3),
+    // 8. cast
+    SONG_NOTE(TONE_C, 4), SONG_NOTE(TONE_C, 4), SONG_REST(1), SONG_NOTE(TONE_C, 4),
+    SONG_REST(1), SONG_NOTE(TONE_C, 4), SONG_NOTE(TONE_D, 4), SONG_NOTE(TONE_E, 4),
+    SONG_REST(7),
+    SONG_END
+};
+
+/**
+ * TABULKA SKLADIEB
+ * Za DEMO skladbou nasleduju skladby zo songs.h, ktory generuje sim/midi2song.c z MIDI suborov.
+ * Prikaz SONG skladbu vyberie a prehra, klavesa D prehra naposledy vybranu skladbu.
+ */
+typedef struct {
+    char *name;                 // nazov skladby pre displej a terminal
+    const unsigned char *data;  // bajtkod skladby vo flash pamati
+} song_t;
+
+const song_t songs[] = {
+    {"demo", demo_song},
+    SONG_TABLE
+};
+
+#define SONGS (sizeof(songs) / sizeof(songs[0]))
+
+unsigned char song_current = 0; // skladba prehravana klavesou D
+
+// stav sekvencera skladby (meneny v preruseni od CCR1 casovaca A)
+const unsigned char *seq_pc;        // aktualna pozicia v bajtkode skladby
+unsigned int seq_tick = SONG_DEFAULT_TICK; // dlzka tiku skladby v tikoch ACLK
+unsigned char seq_len = 1;          // dlzka tonu v tikoch skladby
+unsigned long seq_wait = 0;         // zostavajuci cas do dalsej udalosti v tikoch ACLK
+unsigned char seq_note = VOICE_FREE; // ton prave hrany sekvencerom
+volatile unsigned char seq_state = SEQ_STOPPED;
+unsigned char seq_src = SEQ_SRC_FLASH;
+
+/**
+ * Fronta bajtkodu pre sekvencer: zapisuje iba hlavna slucka (seq_q_head), cita iba prerusenie (seq_q_tail).
+ * Viacbajtovy prikaz sa zverejni posunutim seq_q_head az po zapise vsetkych bajtov,
+ * sekvencer teda nikdy nevidi neuplny prikaz a fronta nepotrebuje zakazovat prerusenia.
+ */
+unsigned char seq_queue[SEQ_QUEUE_SIZE];
+volatile unsigned char seq_q_head = 0;
+volatile unsigned char seq_q_tail = 0;
+volatile unsigned char seq_q_want = 0; // volne miesto, na ktore caka plniaca uloha (0 = ziadna necaka)
+unsigned char seq_q_waiter;            // plniaca uloha, ktoru spusti krok sekvencera po uvolneni miesta
+
+/**
+ * PARSER MELODIE
+ * Melodia sa zadava textom, napr. "T120 C4/4 D4/8 R/8 F#5/2.", tokeny sa oddeluju medzerou alebo ciarkou.
+ * Tn               - tempo n stvrtovych not za minutu (MEL_TEMPO_MIN az MEL_TEMPO_MAX)
+ * X[#|b][o][/d][.] - ton X (A-G), posuvka, oktava o (0-7), dlzka 1/d celej noty (d = 1, 2, 4, ..., 32),
+ *                    bodka predlzi ton o polovicu
+ * R[/d][.]         - pauza
+ * Vynechana oktava a dlzka sa preberaju z predchadzajuceho tokenu.
+ * Text sa spracuva po znakoch, kazdy dokonceny token sa hned prelozi do bajtkodu a zaradi do fronty
+ * sekvencera, takze prve tony znia este pocas spracovania zvysku textu. Prikaz PLAY text iba skopiruje
+ * do kruhoveho buffra mel_input, spracuva ho uloha melody_task po castiach, ktore sa zmestia do fronty.
+ *
+ * PRIJEM DLHEJ MELODIE (prikaz STREAM)
+ * Po prikaze STREAM sa kazdy dalsi riadok terminalu prida do mel_input ako pokracovanie melodie,
+ * riadok END prijem ukonci a STOP ho zrusi. Melodia sa hra uz pocas prijmu, jej dlzka teda nie je
+ * obmedzena pamatou. Ked v buffri zostane menej nez MEL_XOFF_FREE volnych znakov, posle sa terminalu
+ * XOFF, a ked ho uloha melody_task uvolni aspon na MEL_XON_FREE, posle sa XON (terminal musi mat
+ * zapnute softverove riadenie toku). Rezerva MEL_XOFF_FREE pokryva riadok, ktory uz bol odoslany
+ * pred prijatim XOFF.
+ */
+#define MEL_INPUT_SIZE 256 // kruhovy buffer textu melodie, mocnina 2
+#define MEL_INPUT_MASK (MEL_INPUT_SIZE - 1)
+#define MEL_LINE_MAX 80   // najdlhsi riadok melodie (text prikazu PLAY alebo riadok v rezime STREAM)
+#define MEL_LINE_END '\n' // oddelovac riadkov v mel_input
+#define MEL_XOFF_FREE (2 * MEL_LINE_MAX) // menej volneho miesta zastavi terminal
+#define MEL_XON_FREE (3 * MEL_LINE_MAX)  // aspon tolko volneho miesta terminal znova spusti
+#define XON 0x11
+#define XOFF 0x13
+#define MEL_CMD_MAX 3     // najviac bajtov bajtkodu z jedneho tokenu
+#define MEL_INPUT_NONE 0  // ziadny text na spracovanie
+#define MEL_INPUT_BEGIN 1 // text caka na zaciatok melodie (melody_begin)
+#define MEL_INPUT_FEED 2  // text sa spracuva
+#define MEL_WHOLE 64 // tikov skladby na celu notu (1/32 s bodkou = 3 tiky)
+#define MEL_TEMPO_MIN 30
+#define MEL_TEMPO_MAX 400
+#define MEL_TEMPO_TICK(bpm) (TICKS_PER_SECOND * 60UL / ((bpm) * (MEL_WHOLE / 4))) // tik skladby v tikoch ACLK
+#define MEL_REST 0xFF // oznacenie pauzy v mel_note
+
+// stavy parsera melodie
+#define MEL_IDLE 0   // medzi tokenmi
+#define MEL_NAME 1   // za nazvom tonu alebo pauzy
+#define MEL_ACC 2    // za posuvkou
+#define MEL_OCTAVE 3 // za oktavou
+#define MEL_SLASH 4  // za lomitkom, ocakava sa delitel
+#define MEL_DIV 5    // v deliteli dlzky
+#define MEL_DOT 6    // za bodkou
+#define MEL_TEMPO 7  // v cisle tempa
+#define MEL_SKIP 8   // preskakovanie chybneho tokenu
+
+// pozicia tonu v oktave pre pismena A az G
+const unsigned char mel_tones[7] = {TONE_A, TONE_B, TONE_C, TONE_D, TONE_E, TONE_F, TONE_G};
+
+unsigned char mel_state = MEL_IDLE;
+unsigned char mel_column;           // stlpec aktualneho znaku v prikazovom riadku
+unsigned char mel_token;            // stlpec zaciatku aktualneho tokenu
+unsigned char mel_note;             // ton tokenu (pozicia v oktave) alebo MEL_REST
+signed char mel_acc;                // posuvka -1, 0, +1
+unsigned char mel_octave = 4;       // oktava, prebera sa z predchadzajuceho tonu
+unsigned char mel_tok_octave;       // oktava aktualneho tokenu
+unsigned char mel_div = 4;          // delitel dlzky, prebera sa z predchadzajuceho tokenu
+unsigned char mel_dot;              // bodkovana dlzka
+unsigned int mel_num;               // citane cislo (delitel, tempo)
+unsigned int mel_tempo = 120;       // tempo v stvrtovych notach za minutu
+unsigned char mel_len;              // dlzka tonu naposledy zapisana do fronty (0 = neznama)
+char mel_input[MEL_INPUT_SIZE];     // text melodie z prikazu PLAY alebo z rezimu STREAM
+unsigned int mel_in_head = 0;       // index zapisu dalsieho znaku
+unsigned int mel_in_tail = 0;       // index dalsieho spracovaneho znaku
+unsigned char mel_input_state = MEL_INPUT_NONE;
+unsigned char mel_stream = 0;       // prijimaju sa riadky melodie (rezim STREAM)
+unsigned char mel_xoff = 0;         // terminalu bol poslany XOFF
+
+// posledny precitany stav klavesnice (detekcia stlacenia a uvolnenia klavesy)
+unsigned int last_keyboard_input = 0;
+
+/**
+ * FIFO UDALOSTI KLAVESNICE
+ * FPGA pri kazdej zmene stavu klaves ulozi novy stav do FIFO a kym FIFO nie je prazdne,
+ * drzi linku IRQ v log. 1. Citanie adresy KEY_FIFO_ADDR vyberie najstarsi stav z FIFO.
+ */
+#define KEY_FIFO_ADDR 0x02  // adresa FIFO klavesnice v FPGA
+#define KEY_IRQ_PIN BIT0    // linka IRQ z FPGA na P1.0
 
-// globalne premenne pre chod generatoru signalu ( generatoru signalov o frekvnecii )
-unsigned int freq = C4;  // defaultna frekvencia nastavena na ton C4
-unsigned int amplitude_scale_x = 0; // amplituda napetia na x-ovej osi vyjadrena v %, kde aplitude_scale_x patri do intervalu <0,100> 
-unsigned int sample_iterator = 1; // defaultne 1 aby bolo zabezbene kmitanie medzi urovnami v log ponimani(kde swap urovne je korigovany prerusenim): 1 0 1 0 1 0
+/**
+ * PAMAT SKLADIEB V FPGA (fpga/song_ram.vhd)
+ * Blokova RAM v FPGA s 1024 16-bitovymi slovami uchovava bajtkod skladby (2 bajty v slove), skladba
+ * tak nezabera flash ani RAM MCU. Zapis na SONG_RAM_ADDR_PTR nastavi adresu slova, kazde slovo
+ * prenesene cez SONG_RAM_ADDR_DATA adresu posunie, blok slov sa teda prenesie jednym vyberom FPGA.
+ * Datovy register FPGA dekoduje cele okno SONG_RAM_ADDR_DATA az SONG_RAM_ADDR_END, blokovy prenos
+ * (najviac SONG_RAM_ADDR_END - SONG_RAM_ADDR_DATA + 1 slov) teda okno neopusti, ani ked SPI_adc
+ * adresu po kazdom slove zvysuje.
+ * Skladba sa nahra prikazom RAM (riadky vytvori sim/midi2song -l) a uloha TASK_SONG_RAM ju pocas
+ * hrania cita po SONG_RAM_BURST slovach do fronty sekvencera.
+ */
+#define SONG_RAM_ADDR_PTR 0x20  // adresa slova (ukazatel)
+#define SONG_RAM_ADDR_DATA 0x21 // slovo na adrese ukazatela, prenos ukazatel posunie
+#define SONG_RAM_ADDR_END 0x3F  // koniec okna datoveho registra
+#define SONG_RAM_BYTES 2048
+#define SONG_RAM_BURST 8        // slov citanych jednym prenosom
+#define SONG_RAM_LINE 24        // najviac bajtov v jednom prikaze RAM (riadok do 80 znakov)
+#if (SONG_RAM_BURST > SONG_RAM_ADDR_END - SONG_RAM_ADDR_DATA + 1) || (SONG_RAM_LINE / 2 > SONG_RAM_ADDR_END - SONG_RAM_ADDR_DATA + 1)
+#error Blokovy prenos pamate skladieb je dlhsi nez okno datoveho registra
+#endif
+
+unsigned int song_ram_size = 0;    // pocet nahratych bajtov (adresa dalsieho zapisu)
+unsigned int song_ram_pos;         // adresa dalsieho citaneho bajtu pri hrani
+unsigned char song_ram_play = 0;   // skladba z FPGA sa prave cita do fronty sekvencera
+
+// tony zahrane z terminalu, ukonci ich uloha TASK_NOTES_OFF
+#define NOTES_PLAY_MS 300
+unsigned char notes_held[VOICES];
+unsigned char notes_held_count = 0;
+
+#define LCD_CHARS 16 // pocet znakov na jednom riadku displeja
 
-// Pocet tikov je pocitany na zaklade tohoto matematickeho vztahu ticks = TICKS_PER_SECOND / frequency / samples;
-unsigned int ticks;
+/**
+ * TIENOVA PAMAT DISPLEJA
+ * Text sa zapisuje iba do RAM (lcd_print), na displej ho prenasa v hlavnej slucke lcd_idle.
+ * Znakovu pamat displeja drzi FPGA (fpga/lcd_fb.vhd) a displej obnovuje samo s casovanim HD44780.
+ * Zmeneny obsah sa prenesie cely jednym prenosom LCD_CHARS * LCD_LINES / 2 slov, pozicia v FPGA
+ * sa po poslednom znaku vrati na 0, takze ju staci nastavit raz po konfiguracii FPGA.
+ * Datovy register FPGA dekoduje cele okno LCD_FB_ADDR_DATA az LCD_FB_ADDR_END oddelene od FIFO
+ * klavesnice, prenos teda okno neopusti, ani ked SPI_adc adresu po kazdom slove zvysuje.
+ */
+#define LCD_LINES 2
+#define LCD_LINE_STATUS 0   // stav simulatoru (ton, akord, prikaz)
+#define LCD_LINE_PLAYING 1  // ton prave hrany skladbou
+#define LCD_FB_ADDR_POS 0x40  // pozicia znaku v znakovej pamati FPGA
+#define LCD_FB_ADDR_DATA 0x41 // dva znaky, zapis posunie poziciu
+#define LCD_FB_ADDR_END 0x5F  // koniec okna datoveho registra
+#if LCD_CHARS * LCD_LINES / 2 > LCD_FB_ADDR_END - LCD_FB_ADDR_DATA + 1
+#error Prenos displeja je dlhsi nez okno datoveho registra
+#endif
+#define LCD_NOT_PLAYING 0xFE // lcd_playing: skladba nehra
+
+char lcd_text[LCD_LINES][LCD_CHARS];  // pozadovany obsah displeja
+unsigned char lcd_dirty = 0;          // lcd_text sa zmenil od posledneho prenosu
+unsigned char lcd_ready = 0;          // displej je inicializovany (FPGA je nakonfigurovane)
+unsigned char lcd_playing = LCD_NOT_PLAYING; // ton zobrazeny v riadku LCD_LINE_PLAYING
+
+// nazvy tonov v oktave pre displej
+const char note_names[12][2] = {"C ", "C#", "D ", "D#", "E ", "F ", "F#", "G ", "G#", "A ", "A#", "B "};
+
+// priradenie klaves klavesnice k tonom
+#define KEY_NOTES 14
+
+typedef struct {
+    unsigned int key;   // bit klavesy v slove klavesnice
+    unsigned char note; // MIDI cislo tonu
+    char *label;        // nazov tonu pre displej
+} key_note_t;
+
+const key_note_t key_notes[KEY_NOTES] = {
+    // jednociarkova oktava
+    {KEY_1, C4, "C4 (c')"}, {KEY_2, D4, "D4 (d')"}, {KEY_3, E4, "E4 (e')"}, {KEY_A, F4, "F4 (f')"},
+    {KEY_4, G4, "G4 (g')"}, {KEY_5, A4, "A4 (a')"}, {KEY_6, B4, "B4 (h')"},
+    // dvojciarkova oktava
+    {KEY_7, C5, "C5 (c'')"}, {KEY_8, D5, "D5 (d'')"}, {KEY_9, E5, "E5 (e'')"}, {KEY_C, F5, "F5 (f'')"},
+    {KEY_h, G5, "G5 (g'')"}, {KEY_0, A5, "A5 (a'')"}, {KEY_m, B5, "B5 (h'')"}
+};
 
 // prototypy funkcii pre potreby vykonania skor nez main() alebo pouzitia v main()
-void part1_demo();
-void part2_demo();
-void part3_demo();
-void part4_demo();
-void part5_demo();
-void part6_demo();
-void part7_demo();
-void part8_demo();
+unsigned long note_to_inc(unsigned char note);
+unsigned long audio_inc(unsigned long inc);
+#ifdef AUDIO_SMCLK
+unsigned int clock_measure(unsigned int periods);
+void dco_tune(void);
+void clock_calibrate(void);
+#endif
+void voices_init(void);
+unsigned char note_octave(unsigned char note);
+void voice_publish(voice_t *v, unsigned char note, unsigned char gate);
+void voice_latch(voice_t *v);
+unsigned char voice_note_on(unsigned char note);
+void voice_note_off(unsigned char note);
+unsigned char env_update(voice_t *v);
+void note_on(unsigned char note);
+void note_off(unsigned char note);
+void seq_play(const unsigned char *song);
+void seq_stop(void);
+void seq_step(void);
+unsigned char seq_fetch(void);
 void play_demo();
-interrupt (TIMERA0_VECTOR) Timer_A (void);
+void song_play(unsigned char index);
+void seq_play_queue(void);
+unsigned char seq_queue_put(const unsigned char *data, unsigned char n);
+unsigned char seq_queue_free(void);
+void seq_queue_wait(unsigned char id, unsigned char n);
+void melody_begin(unsigned char column);
+void melody_feed(char c);
+void melody_task(void);
+unsigned int mel_input_free(void);
+unsigned char mel_input_put(const char *text);
+void mel_input_reset(void);
+void mel_flow(char c);
+void mel_stream_line(char *UserCommand, char *ComparedCommand);
+unsigned char audio_render(unsigned int *buf);
+#ifdef AUDIO_PWM
+void pwm_convert(unsigned int *buf);
+#endif
+void audio_start(void);
+void audio_stop(void);
+void cpu_sleep(void);
+void task_signal(unsigned char id);
+void task_at(unsigned char id, unsigned int ticks);
+void sched_run(void) __attribute__((noreturn));
+void nco_idle(void);
+void lcd_print(unsigned char line, const char *text);
+void lcd_print_label(unsigned char line, const char *label, const char *name);
+unsigned char note_name(unsigned char note, char *text);
+void lcd_idle(void);
+interrupt (DACDMA_VECTOR) Audio_DMA (void);
+interrupt (TIMERA1_VECTOR) Timer_A1 (void);
 void print_user_help(void);
 void fpga_initialized();
 unsigned char decode_user_cmd(char *UserCommand, char *ComparedCommand);
-char tone_decoder(unsigned int keyboard_input);
-int keyboard_idle();
+unsigned char note_decode(const char *text, unsigned char *note);
+void notes_play(const unsigned char *notes, unsigned char count, char *text);
+void notes_release(void);
+void cmd_demo(char *args);
+void cmd_stop(char *args);
+void cmd_play(char *args);
+void cmd_stream(char *args);
+void cmd_ram(char *args);
+void song_ram_task(void);
+void seq_feed_stop(void);
+void cmd_inst(char *args);
+void cmd_song(char *args);
+unsigned char arg_number(const char *arg);
+unsigned char name_equal(const char *name, const char *arg);
+void instrument_select(unsigned char index);
+#ifdef STATS
+void stats_time(stats_time_t *t, unsigned int ticks);
+void stats_reset(void);
+void stats_print(char *name, stats_time_t *t);
+void stats_lat_start(unsigned char path, unsigned int stamp);
+void stats_lat_done(unsigned char paths);
+unsigned int stats_lat_percentile(unsigned char path, unsigned char pct, unsigned int count);
+void cmd_stats(char *args);
+#endif
+void mel_error(void);
+unsigned char mel_emit(void);
+unsigned char tone_decoder(unsigned int keyboard_input, unsigned char *pressed);
+void key_event(unsigned int keyboard_input);
+void keyboard_idle(void);
+interrupt (PORT1_VECTOR) Key_IRQ (void);
 
-
-// Hlavna funkcia main pre obsluhu s hlavnym cyklom pre obsluhu klavesnice a terminalu
+/**
+ * TABULKA PRIKAZOV TERMINALU
+ * Prikaz sa vyhlada hashom z prvych troch znakov v jednom kroku a overi jednym porovnanim nazvu.
+ * Pri pridani prikazu treba overit, ze jeho hash nekoliduje s existujucim (GCC pri kolizii
+ * inicializatorov hlasi -Woverride-init).
+ */
+#define CMD_HASH_SIZE 16 // mocnina 2
+#define CMD_HASH(c0, c1, c2) (((c0) + ((c1) << 1) + (c2)) & (CMD_HASH_SIZE - 1))
+
+typedef struct {
+    char *name;                  // nazov prikazu velkymi pismenami
+    void (*handler)(char *args); // obsluha, args je zvysok riadku za nazvom
+} cmd_t;
+
+const cmd_t cmd_table[CMD_HASH_SIZE] = {
+    [CMD_HASH('D', 'E', 'M')] = {"DEMO", cmd_demo},
+    [CMD_HASH('S', 'T', 'O')] = {"STOP", cmd_stop},
+    [CMD_HASH('P', 'L', 'A')] = {"PLAY", cmd_play},
+    [CMD_HASH('S', 'T', 'R')] = {"STREAM", cmd_stream},
+    [CMD_HASH('R', 'A', 'M')] = {"RAM", cmd_ram},
+    [CMD_HASH('I', 'N', 'S')] = {"INST", cmd_inst},
+    [CMD_HASH('S', 'O', 'N')] = {"SONG", cmd_song},
+#ifdef STATS
+    [CMD_HASH('S', 'T', 'A')] = {"STATS", cmd_stats},
+#endif
+};
+
+// tabulka uloh planovaca, terminy periodickych uloh sa nastavia v main
+task_t tasks[TASKS] = {
+    [TASK_KEYBOARD]  = {keyboard_idle, 0, 0, 0, 1}, // na zaciatku sa vyprazdni FIFO klavesnice
+    [TASK_NOTES_OFF] = {notes_release, 0},
+    [TASK_TERMINAL]  = {terminal_idle, TASK_TICKS_MS(10)},
+    [TASK_MELODY]    = {melody_task, 0},   // signal od prikazu PLAY, terminalu a sekvencera (seq_queue_wait)
+    [TASK_SONG_RAM]  = {song_ram_task, 0}, // signal od prikazu RAM PLAY a sekvencera (seq_queue_wait)
+    [TASK_LCD]       = {lcd_idle, 0},      // signal od lcd_print a kroku sekvencera
+#ifdef AUDIO_NCO
+    [TASK_NCO]       = {nco_idle, 0},
+#endif
+};
+
+#ifdef STATS
+char *const task_names[TASKS] = {
+    [TASK_KEYBOARD]  = "klavesnica",
+    [TASK_NOTES_OFF] = "koniec tonu",
+    [TASK_TERMINAL]  = "terminal",
+    [TASK_MELODY]    = "melodia",
+    [TASK_SONG_RAM]  = "skladba z FPGA",
+    [TASK_LCD]       = "displej",
+#ifdef AUDIO_NCO
+    [TASK_NCO]       = "NCO",
+#endif
+};
+
+char *const stats_lat_names[STATS_LAT_PATHS] = {
+    [STATS_LAT_KEYBOARD]  = "klavesnica",
+    [STATS_LAT_TERMINAL]  = "terminal",
+    [STATS_LAT_SEQUENCER] = "sekvencer",
+};
+#endif
+
+
+// Hlavna funkcia main, hlavnym cyklom je planovac uloh (klavesnica, terminal, displej)
 int main(void)
 {
+    unsigned char i;
+
     initialize_hardware();
     WDG_stop(); //stop watchdog char_cnt
     
-    // inicializacia tikov na zaklade podielu tikov za sekundu, frequencie daneho tonu a poctom vzoriek signalu (v nasom pripade obdlznikovy)
-    ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
+    // vsetky hlasy su na zaciatku volne a tiche
+    voices_init();
 
-    // Nastavenie casovaca (pouziti demo kod s blikajucou LED)
-    CCTL0 = CCIE; // povolenie prerusenia pre casovac (rezim vstupnej komparacie)
-    CCR0 = ticks; // pocet tikov, po ktorych pride k preruseniu
+#ifdef AUDIO_SMCLK
+    // meranie SMCLK pouziva casovac A, preto prebehne pred jeho nastavenim pre sekvencer
+    clock_calibrate();
+#endif
+
+    // Nastavenie casovaca A pre sekvencer skladby (pouziti demo kod s blikajucou LED)
     TACTL = TASSEL_1 + MC_2; // ACLK (f_tiku = 32768 Hz = 0x8000 Hz), nepretrzity rezim
 
     
-    /**
-     * Potrebujem na analogovu periferiu (reproduktor) prekonvertovat digitalne zlozky, takze si to vyzaduje aby bol pouzity DA prevodnik
-     * Nastavenie AD prevodniku, v DA prevodniku sa odkazujeme na referencne napetie, 
-     * vychadzam z dokumentacie a nadobudol som predpokladu ze si ho musim nastavit najprv
-     */ 
-    
-    ADC12CTL0 |= 0x0020;    // nastavenie refeencneho napetia na 1,5 V, je mozne ist az na 2,5V.
-    DAC12_0CTL |= 0x1060;   // nastavenie kontrolneho registra DAC (na 8-bitovy rezim, medium speed)
-    DAC12_0CTL |= 0x100;    // referencne napeti nasobit 1x, podla dokumentacie je mozne nasobit referencne napetie aj 3x, co myslim ze tu nepotrebujem
+    // DA prevodnik, reference a DMA sa zapnu az s prvym tonom (audio_start)
 
-    while (1)
-    {   
-        keyboard_idle();
-        terminal_idle();
-    }
-}
-
-    void part1_demo() {
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-        
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-    
-        delay_ms(150);
+    // prerusenie od nabeznej hrany linky IRQ z FPGA (neprazdne FIFO klavesnice)
+    P1DIR &= ~KEY_IRQ_PIN;
+    P1IES &= ~KEY_IRQ_PIN;
+    P1IFG &= ~KEY_IRQ_PIN;
+    P1IE |= KEY_IRQ_PIN;
 
-        freq = G4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-    
-        delay_ms(450);
-    
-        freq = G3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
+    // budenie planovaca v terminoch uloh (CCR2 nastavuje sched_run)
+    for (i = 0; i < TASKS; i++)
+    {
+        tasks[i].deadline = TAR;
+        tasks[i].timed = (tasks[i].period != 0);
+    }
+    sched_run();
+}
 
-        delay_ms(450);
+// Prevod MIDI cisla tonu na prirastok fazy, tony mimo rozsahu tabulky sa obmedzia na krajne tony
+unsigned long note_to_inc(unsigned char note)
+{
+    if (note < NOTE_FIRST) 
+    {
+        note = NOTE_FIRST;
     }
-    
-    void part2_demo() {
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-        
-        delay_ms(300);
-
-        freq = G3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(300);
-
-        freq = E3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(300);
-
-        freq = A3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = B3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-    
-        delay_ms(150);
-
-        freq = AS3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = A3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-        
-        delay_ms(150);
-    }
-
-    void part3_demo () {
-        freq = G3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = G4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = A4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = F4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = G4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = D4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = B3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(300);
-    }
-
-    void part4_demo() {
-        delay_ms(300);
-        
-        freq = G4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = FS4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = F4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = EB4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = GS3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = A3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = A3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = D4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-    }
-
-    void part5_demo() {
-        delay_ms(300);
- 
-        freq = G4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = FS4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = F4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = EB4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = C5;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = C5;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C5;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(450);
-    }
-
-    void part6_demo() {
-        delay_ms(300);
-        
-        freq = EB4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(300);
-
-        freq = D4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(300);
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(1050);
-    }
-
-
-    void part7_demo() {
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = D4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(150);
-
-        freq = A3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = G3;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(450);
-    }
-
-    void part8_demo(){
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
+    else if (note > NOTE_LAST) 
+    {
+        note = NOTE_LAST;
+    }
+    return note_inc_table[note - NOTE_FIRST];
+}
+
+/**
+ * Korekcia prirastku fazy z tabulky (pre SAMPLE_RATE) na skutocnu vzorkovaciu frekvenciu.
+ * Pri vzorkovani z ACLK je vzorkovacia frekvencia presne SAMPLE_RATE a prirastok sa nemeni.
+ */
+unsigned long audio_inc(unsigned long inc)
+{
+#ifdef AUDIO_SMCLK
+    // inc * audio_inc_scale / 2^15 bez 48-bitoveho medzivysledku
+    return (((inc >> 16) * audio_inc_scale) << 1) + (((inc & 0xFFFF) * audio_inc_scale) >> 15);
+#else
+    return inc;
+#endif
+}
 
-        delay_ms(150);
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
+#ifdef AUDIO_SMCLK
+/**
+ * Pocet tikov SMCLK za periods period ACLK. Casovac A pocas merania bezi zo SMCLK a nabezna hrana
+ * ACLK (vstup CCI2B) zachytava TAR do CCR2. Vysledok musi byt mensi nez 65536.
+ */
+unsigned int clock_measure(unsigned int periods)
+{
+    unsigned int start;
 
-        delay_ms(150);
-
-        freq = C4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
+    TACTL = TASSEL_2 + MC_2 + TACLR;
+    CCTL2 = CM_1 + CCIS_1 + SCS + CAP;
 
-        freq = D4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        freq = E4;
-        ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-		amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-		delay_ms(150);
-		amplitude_scale_x = 0;
-
-        delay_ms(1050);
+    while (!(CCTL2 & CCIFG)) nop();
+    CCTL2 &= ~CCIFG;
+    start = CCR2;
+    while (periods--)
+    {
+        while (!(CCTL2 & CCIFG)) nop();
+        CCTL2 &= ~CCIFG;
     }
-    
-    void play_demo() {
-        part1_demo();
-        part2_demo();
-        part3_demo();
-        part4_demo();
-        part5_demo();
-        part6_demo();
-        part7_demo();
-        part8_demo();
-    }
-
-interrupt (TIMERA0_VECTOR) Timer_A (void)
-{ 	
-		// ABY TO HRALO MUSI TO "KMITAT", takze striedam urovne 255 0
-		if(sample_iterator == 2) {sample_iterator = 0;} 
-		
-		/*
-	        * reagujem na prerusenie z klavesnice, aby som dosiahol ziadaneho efektu hudonneho nastroja
-		* takze spracovavane data prevodnikom musia
-		*/
-		DAC12_0DAT = (arr_square[sample_iterator]*amplitude_scale_x)/100; // nahratie dalsieho vzorku pre prevod
-		CCR0 += ticks; // pocet tikov po ktorych pride k dalsiemu preruseniu a nasledne prevodu 
-		sample_iterator++;
-	
+    return CCR2 - start;
 }
 
-void print_user_help(void)
-{         
-	term_send_str_crlf("Ovladanie hudnobneho simulatoru");
-	term_send_str_crlf("Ovladanie klavesnice");
-	
-    // jednociarkova oktava
-	term_send_str_crlf(">-klavesa '1' zahra ton C4(c')");
-	term_send_str_crlf(">-klavesa '2' zahra ton D4(d')");
-	term_send_str_crlf(">-klavesa '3' zahra ton E4(e')");
-	term_send_str_crlf(">-klavesa 'A' zahra ton F4(f')");
-	term_send_str_crlf(">-klavesa '4' zahra ton G4(g')");
-	term_send_str_crlf(">-klavesa '5' zahra ton A4(a')");
-	term_send_str_crlf(">-klavesa '6' zahra ton B4(h')");
-	
-    // dvojciarkova oktava
-	term_send_str_crlf(">-klavesa '7' zahra ton C5(c'')");
-	term_send_str_crlf(">-klavesa '8' zahra ton D5(d'')");
-	term_send_str_crlf(">-klavesa '9' zahra ton E5(e'')");
-	term_send_str_crlf(">-klavesa 'C' zahra ton F5(f'')");
-	term_send_str_crlf(">-klavesa '*' zahra ton G5(g'')");
-	term_send_str_crlf(">-klavesa '0' zahra ton A5(a'')");
-	term_send_str_crlf(">-klavesa '6' zahra ton B4(h'')");
-	 
-	// song
-	term_send_str_crlf(">-klavesa 'D' a prehra demo skladbu");
+/**
+ * Doladenie DCO na AUDIO_SMCLK_HZ. RSELx a DCOCTL tvoria spolu 11-bitovy kod frekvencie,
+ * daleko od ciela sa kod meni po krokoch DCOx, blizko po krokoch modulacie.
+ */
+void dco_tune(void)
+{
+    unsigned char i;
+    unsigned int count, diff, code;
+
+    code = ((BCSCTL1 & DCO_RSEL_MASK) << 8) | DCOCTL;
+    for (i = 0; i < DCO_TUNE_STEPS; i++)
+    {
+        count = clock_measure(DCO_TUNE_PERIODS);
+        diff = (count < DCO_TUNE_TARGET) ? DCO_TUNE_TARGET - count : count - DCO_TUNE_TARGET;
+        if (diff <= 1)
+        {
+            break;
+        }
+        if (count < DCO_TUNE_TARGET)
+        {
+            if (code >= 0x7FF)
+            {
+                break; // DCO nedosiahne pozadovanu frekvenciu, pouzije sa najvyssia
+            }
+            code += (diff > DCO_TUNE_TARGET / 32) ? 0x20 : 1;
+        }
+        else
+        {
+            if (code == 0)
+            {
+                break;
+            }
+            code -= (diff > DCO_TUNE_TARGET / 32) ? 0x20 : 1;
+        }
+        if (code > 0x7FF)
+        {
+            code = (count < DCO_TUNE_TARGET) ? 0x7FF : 0;
+        }
+        BCSCTL1 = (BCSCTL1 & ~DCO_RSEL_MASK) | (code >> 8);
+        DCOCTL = code & 0xFF;
+    }
+}
 
+/**
+ * Kalibracia taktu vzorkovania pri starte: doladenie DCO (ak SMCLK nebezi z XT2), meranie SMCLK,
+ * vypocet periody casovaca B a korekcie prirastkov fazy.
+ */
+void clock_calibrate(void)
+{
+    unsigned int count;
 
-	term_send_str_crlf("Ovladanie terminalom");
-	// jednociarkova oktava
-	term_send_str_crlf(">-zadaj prikaz 'C4' a zahra sa ton C4(c')");
-	term_send_str_crlf(">-zadaj prikaz 'D4' a zahra sa ton D4(d')");
-	term_send_str_crlf(">-zadaj prikaz 'E4' a zahra sa ton E4(e')");
-	term_send_str_crlf(">-zadaj prikaz 'F4' a zahra sa ton F4(f')");
-	term_send_str_crlf(">-zadaj prikaz 'G4' a zahra sa ton G4(g')");
-	term_send_str_crlf(">-zadaj prikaz 'A4' a zahra sa ton A4(a')");
-	term_send_str_crlf(">-zadaj prikaz 'B4' a zahra sa ton B4(h')");
-	
-    // dvojciarkova oktava
-	term_send_str_crlf(">-zadaj prikaz 'C5' a zahra sa ton C5(c'')");
-	term_send_str_crlf(">-zadaj prikaz 'D5' a zahra sa ton D5(d'')");
-	term_send_str_crlf(">-zadaj prikaz 'E5' a zahra sa ton E5(e'')");
-	term_send_str_crlf(">-zadaj prikaz 'F5' a zahra sa ton F5(f'')");
-	term_send_str_crlf(">-zadaj prikaz 'G5' a zahra sa ton G5(g'')");
-	term_send_str_crlf(">-zadaj prikaz 'A5' a zahra sa ton A5(a'')");
-	term_send_str_crlf(">-zadaj prikaz 'B4' a zahra sa ton B4(h'')");
-	 
-	// song
-	term_send_str_crlf(">-zadaj prikaz 'DEMO' a prehra demo skladbu");
+    if (!(BCSCTL2 & SELS))
+    {
+        dco_tune();
+    }
+    count = clock_measure(CAL_ACLK_PERIODS);
+    TACTL = 0;
+    CCTL2 = 0;
+
+    audio_smclk = (unsigned long)count * CAL_COUNT_HZ;
+#ifndef AUDIO_PWM
+    audio_period = (audio_smclk + SAMPLE_RATE / 2) / SAMPLE_RATE;
+#else
+    // perioda vzorkovania je celym nasobkom periody nosnej
+    pwm_period = (audio_smclk + PWM_RATE / 2) / PWM_RATE;
+    audio_period = pwm_period * PWM_OVERSAMPLE;
+#endif
+    // SAMPLE_RATE / (audio_smclk / audio_period) = audio_period * SAMPLE_RATE / CAL_COUNT_HZ / count
+    audio_inc_scale = ((unsigned long)audio_period * (SAMPLE_RATE / CAL_COUNT_HZ) * AUDIO_INC_ONE + count / 2) / count;
 }
+#endif
 
-// Incializacia periferii
-void fpga_initialized()
-{ 
-    LCD_init();
-    LCD_write_string("Simulator hudby");
-	
-    // poslanie infa do terminalu
-    term_send_str_crlf(" ");   
-    term_send_str_crlf("SIMULATOR HUDBY POMOCOU DA PREVODNIKA");
-    term_send_str_crlf("Napetie je generovane na 0. kanálu DA prevodniku mikrokontrolera.");
-    term_send_str_crlf("Prosim pripojte svoj reproduktor na pin c. 31 JP9 pinoveho pola a GND pin");
-    term_send_str_crlf("Ovladanie je mozne pomocou klavesnice aj terminalu");
-    term_send_str_crlf("Napiste 'help' pre popis ovladania");
+// Inicializacia hlasov - vsetky su volne a tiche
+void voices_init(void)
+{
+    unsigned char i;
 
+    for (i = 0; i < VOICES; i++)
+    {
+        voices[i].phase = 0;
+        voices[i].phase_inc = 0;
+        voices[i].inst = &instruments[0];
+        voices[i].wave = instruments[0].waves[0];
+        voices[i].env_level = 0;
+        voices[i].env_state = ENV_IDLE;
+        voices[i].latched = 0;
+        voices[i].param[0].phase_inc = 0;
+        voices[i].param[0].inst = &instruments[0];
+        voices[i].param[0].wave = instruments[0].waves[0];
+        voices[i].param[0].gate = 0;
+        voices[i].seq = 0;
+        voices[i].note = VOICE_FREE;
+        voices[i].age = 0;
+    }
 }
 
-// Dekodovanie prikazov uzivatela  v terminale
-unsigned char decode_user_cmd(char *UserCommand, char *ComparedCommand) 
-{   
-    	if (strcmp2(UserCommand, "C4"))
-        {
-         	LCD_write_string("Ton: C4 (c')");// vycisti obrazovku a zapis retazec na displej fitkitu
-            freq = C4;
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		
-		}
-		else if (strcmp2(UserCommand, "D4"))
-        {
-        	LCD_write_string("Ton: D4 (d')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = D4;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice
-			delay_ms(300);
-			amplitude_scale_x = 0;		
-		}
-		else if (strcmp2(UserCommand, "E4"))
-        {
-         	LCD_write_string("Ton: E4 (e')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = E4;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		else if (strcmp2(UserCommand, "F4"))
-        {
-         	LCD_write_string("Ton: F4 (f')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = F4;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-		
-		else if (strcmp2(UserCommand, "G4"))
-        { 
-         	LCD_write_string("Ton: G4 (g')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = G4;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		else if (strcmp2(UserCommand, "A4"))
-        { 
-         	LCD_write_string("Ton: A4 (a')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = A4;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-
-		else if (strcmp2(UserCommand, "B4"))
-        { 
-         	LCD_write_string("Ton: B4 (h')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = B4;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;		
-		
-		}
-    
-		else if (strcmp2(UserCommand, "C5"))
-        {
-         	LCD_write_string("Ton: C5 (c'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = C5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-
-		else if (strcmp2(UserCommand, "D5"))
-        {
-        	LCD_write_string("Ton: D5 (d'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = D5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-
-		else if (strcmp2(UserCommand, "E5"))
-        { 
-         	LCD_write_string("Ton: E5 (e'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = E5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		else if (strcmp2(UserCommand, "F5"))
-        { 
-         	LCD_write_string("Ton: F5 (f'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = F5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-		
-		else if (strcmp2(UserCommand, "G5"))
-        { 
-         	LCD_write_string("Ton: G5 (g'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = G5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		else if (strcmp2(UserCommand, "A5")) 
-        {     
-    	    LCD_write_string("Ton: A5 (a'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = A5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-
-		else if (strcmp2(UserCommand, "B5")) 
-        { 
-        	LCD_write_string("Ton: B5 (h'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			freq = B5;
-            ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-        else if (strcmp4(UserCommand, "DEMO")) 
-        { 
-        	LCD_write_string("Hra DEMO skladba");// vycisti obrazovku a zapis retazec na displej fitkitu
-            play_demo();
-		}
-        else 
+// Oktava tonu pre vyber tabulky vzoriek, tony mimo rozsahu sa obmedzia na krajne oktavy
+unsigned char note_octave(unsigned char note)
+{
+    if (note < NOTE_FIRST)
+    {
+        return 0;
+    }
+    if (note > NOTE_LAST)
+    {
+        return WAVE_OCTAVES - 1;
+    }
+    return (note - NOTE_FIRST) / 12;
+}
+
+/**
+ * Zverejnenie novych parametrov hlasu generatoru vzoriek (prevezme ich pred dalsim blokom).
+ * Prirastok fazy aj tabulka vzoriek sa urcia z tonu a aktualneho nastroja.
+ */
+void voice_publish(voice_t *v, unsigned char note, unsigned char gate)
+{
+    voice_param_t *p = &v->param[(v->seq + 1) & 1];
+    const instrument_t *inst = &instruments[instrument];
+
+    p->phase_inc = audio_inc(note_to_inc(note));
+    p->inst = inst;
+    p->wave = inst->waves[note_octave(note)];
+    p->gate = gate;
+    v->seq++; // zverejnenie, generator odteraz cita tuto polovicu
+}
+
+/**
+ * Prevzatie zverejnenych parametrov hlasu na zaciatku bloku (v preruseni DMA).
+ * Drzany ton spusti nabeh obalky od aktualnej urovne, uvolneny prejde do doznievania.
+ */
+void voice_latch(voice_t *v)
+{
+    unsigned char seq;
+    const volatile voice_param_t *p; // volatile: kopia sa nepresunie za opatovne citanie seq
+    voice_param_t copy;
+
+    do
+    {
+        seq = v->seq;
+        if (seq == v->latched)
         {
-            return (CMD_UNKNOWN);
+            return;
         }
-        return USER_COMMAND; 
-    
+        p = &v->param[seq & 1];
+        copy.phase_inc = p->phase_inc;
+        copy.inst = p->inst;
+        copy.wave = p->wave;
+        copy.gate = p->gate;
+    } while (seq != v->seq); // zapisovatel medzitym zverejnil a mohol prepisat kopirovanu polovicu
+    v->latched = seq;
+
+    v->phase_inc = copy.phase_inc;
+    if (copy.gate)
+    {
+        v->inst = copy.inst;
+        v->wave = copy.wave;
+        v->env_state = ENV_ATTACK;
+    }
+    else if (v->env_state != ENV_IDLE)
+    {
+        v->env_state = ENV_RELEASE;
+    }
 }
 
+/**
+ * Spustenie tonu na volnom hlase. Ak ziadny hlas nie je volny, pouzije sa najstarsi uvolneny hlas,
+ * a ak ani taky nie je, hlas s najstarsim tonom.
+ * Hlas je volny, ked generator prevzal vsetky jeho parametre a obalka uz dozniela.
+ * Vracia index pouziteho hlasu.
+ */
+unsigned char voice_note_on(unsigned char note)
+{
+    unsigned char i, sel = 0;
+    voice_t *v;
 
-char tone_decoder(unsigned int keyboard_input)
-{	// jednociarkova oktava
-
-	// C4
-	if (keyboard_input & KEY_1)
-       	{
-		freq = C4;
-		return 'C';
-	}
-
-	// D4
-	if (keyboard_input & KEY_2)
-       	{
-		freq = D4;
-		return 'D';
-	}
-
-	// E4
-	if (keyboard_input & KEY_3)
-       	{
-		freq = E4;
-		return 'E';
-	}
-
-	// F4
-	if (keyboard_input & KEY_A)
-       	{
-		freq = F4;
-		return 'F';
-	}
-
-	// G4
-	if (keyboard_input & KEY_4)
-       	{
-		freq = G4;
-		return 'G';
-	}
-
-	// A4
-	if (keyboard_input & KEY_5)
-       	{
-		freq = A4;
-		return 'A';
-	}
-
-	//  B4
-	if (keyboard_input & KEY_6)
-       	{
-		freq = B4;
-		return 'B';
-	}
-
-	// C5
-	if (keyboard_input & KEY_7)
-       	{
-		freq = C5;
-		return '1';
-	}
-
-	// D5
-	if (keyboard_input & KEY_8)
-       	{
-		freq = D5;
-		return '2';
-	}
-
-	// E5
-	if (keyboard_input & KEY_9)
-       	{
-		freq = E5;
-		return '3';
-	}
-
-	// F5
-	if (keyboard_input & KEY_C)
-       	{
-		freq = F5;
-		return '4';
-	}
-
-	// G5
-	if (keyboard_input & KEY_h)
-       	{
-		freq = G5;
-		return '5';
-	}
-
-	// A5
-	if (keyboard_input & KEY_0)
-       	{
-		freq = A5;
-		return '6';
-	}
-
-	//  B5
-	if (keyboard_input & KEY_m)
-       	{
-		freq = B5;
-		return '7';
-	}
-
-	//  DEMO skladba 
-	if (keyboard_input & KEY_D)
-    {
-		return '8';
-	}
-	return PROCESS_OK;
-}
-
-
-
-int keyboard_idle()
-{
-    char ch;
-
-    ch = tone_decoder(read_word_keyboard_4x4());
-
-        if (ch != 0)
-        {
-		
-		if (ch == 'C') {
-         		LCD_write_string("Ton: C4 (c')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		
-		}
-		if (ch == 'D') {
-        		LCD_write_string("Ton: D4 (d')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice
-			delay_ms(300);
-			amplitude_scale_x = 0;		
-		}
-		if (ch == 'E') {
-         	LCD_write_string("Ton: E4 (e')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		if (ch == 'F') { 
-         	LCD_write_string("Ton: F4 (f')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-		
-		if (ch == 'G') { 
-         	LCD_write_string("Ton: G4 (g')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		if (ch == 'A') {
-         	LCD_write_string("Ton: A4 (a')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-
-		if (ch == 'B') { 
-         	LCD_write_string("Ton: B4 (h')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;		
-		
-		}
-    
-		if (ch == '1') {
-         	LCD_write_string("Ton: C5 (c'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-
-		if (ch == '2') {
-        	LCD_write_string("Ton: D5 (d'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-
-		if (ch == '3') { 
-         	LCD_write_string("Ton: E5 (e'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		if (ch == '4') { 
-         	LCD_write_string("Ton: F5 (f'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-		
-		if (ch == '5') {
-         	LCD_write_string("Ton: G5 (g'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-		
-		if (ch == '6') { 
-         	LCD_write_string("Ton: A5 (a'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}		
-
-		if (ch == '7') { 
-         	LCD_write_string("Ton: B5 (h'')");// vycisti obrazovku a zapis retazec na displej fitkitu
-			ticks = TICKS_PER_SECOND/freq/SQUARE_SAMPLES;
-			amplitude_scale_x = 100; // zapnutie hlasitosti a zahratie dekodovaneho tonu z klavesnice		
-			delay_ms(300);
-			amplitude_scale_x = 0;
-		}
-        if (ch == '8') { 
-         	LCD_write_string("Hra DEMO skladba");// vycisti obrazovku a zapis retazec na displej fitkitu
-            play_demo();
-		}
-    		
-	}
+    for (i = 0; i < VOICES; i++)
+    {
+        if ((voices[i].env_state == ENV_IDLE) && (voices[i].latched == voices[i].seq))
+        {
+            sel = i;
+            break;
+        }
+        if (VOICE_PARAM(&voices[i])->gate != VOICE_PARAM(&voices[sel])->gate)
+        {
+            if (!VOICE_PARAM(&voices[i])->gate) // uvolneny hlas ma prednost pred drzanym
+            {
+                sel = i;
+            }
+        }
+        else if ((unsigned int)(voices[i].age - voices[sel].age) & 0x8000) // starsi ton (odolne voci preteceniu)
+        {
+            sel = i;
+        }
+    }
 
-    
-    
+    v = &voices[sel];
+    v->note = note;
+    v->age = ++voice_age;
+    voice_publish(v, note, 1);
 
-return PROCESS_OK;
-    
+#ifndef AUDIO_NCO
+    // audio_on sa testuje az po zverejneni tonu, vypnutie v preruseni DMA tak ton nemoze prehliadnut
+    if (!audio_on)
+    {
+        audio_start();
+    }
+#else
+    task_signal(TASK_NCO);
+#endif
+    return sel;
+}
+
+// Ukoncenie tonu - hlasy drziace dany ton prejdu do doznievania, uvolnia sa az po jeho skonceni
+void voice_note_off(unsigned char note)
+{
+    unsigned char i;
+
+    for (i = 0; i < VOICES; i++)
+    {
+        if ((voices[i].note == note) && VOICE_PARAM(&voices[i])->gate)
+        {
+            voice_publish(&voices[i], note, 0);
+        }
+    }
+#ifdef AUDIO_NCO
+    task_signal(TASK_NCO);
+#endif
+}
+
+/**
+ * Krok obalky hlasu s riadiacou frekvenciou (raz za blok vzoriek).
+ * Vracia uroven hlasitosti hlasu (0 az VOLUME_MAX) zohladnujucu aj celkovu hlasitost volume.
+ */
+unsigned char env_update(voice_t *v)
+{
+    const instrument_t *inst = v->inst;
+    unsigned int level = v->env_level;
+
+    switch (v->env_state)
+    {
+        case ENV_ATTACK:
+            if (level >= ENV_MAX - inst->attack)
+            {
+                level = ENV_MAX;
+                v->env_state = ENV_DECAY;
+            }
+            else
+            {
+                level += inst->attack;
+            }
+            break;
+
+        case ENV_DECAY:
+            if (level - inst->sustain <= inst->decay) // v stave ENV_DECAY plati level >= sustain
+            {
+                level = inst->sustain;
+                v->env_state = ENV_SUSTAIN;
+            }
+            else
+            {
+                level -= inst->decay;
+            }
+            break;
+
+        case ENV_RELEASE:
+            if (level <= inst->release)
+            {
+                level = 0;
+                v->env_state = ENV_IDLE;
+            }
+            else
+            {
+                level -= inst->release;
+            }
+            break;
+
+        default: // ENV_SUSTAIN - uroven sa nemeni
+            break;
+    }
+
+    v->env_level = level;
+    return (((level >> 8) + 1) * volume) >> 8;
+}
+
+/**
+ * Spustenie/ukoncenie tonu z hlavnej slucky. Hlasy prideluje aj sekvencer v preruseni CCR1,
+ * preto sa jeho prerusenie na chvilu zamaskuje (prerusenie generatora signalu bezi dalej).
+ */
+void note_on(unsigned char note)
+{
+    unsigned int seq_ie = CCTL1 & CCIE;
+
+    CCTL1 &= ~CCIE;
+    voice_note_on(note);
+    CCTL1 |= seq_ie;
 }
 
+void note_off(unsigned char note)
+{
+    unsigned int seq_ie = CCTL1 & CCIE;
+
+    CCTL1 &= ~CCIE;
+    voice_note_off(note);
+    CCTL1 |= seq_ie;
+}
+
+// Spustenie prehravania skladby, samotne prehravanie prebieha v preruseni od CCR1 casovaca A
+void seq_play(const unsigned char *song)
+{
+    CCTL1 = 0; // pocas inicializacie nesmie prist prerusenie od sekvencera
+
+    seq_pc = song;
+    seq_src = SEQ_SRC_FLASH;
+    seq_tick = SONG_DEFAULT_TICK;
+    seq_len = 1;
+    seq_wait = 0;
+    seq_note = VOICE_FREE;
+    seq_state = SEQ_PLAYING;
+
+    CCR1 = TAR + 1; // prva udalost skladby sa spracuje hned pri dalsom tiku ACLK
+    CCTL1 = CCIE;
+}
+
+// Zastavenie prehravania skladby (volatelne z hlavnej slucky aj z prerusenia)
+void seq_stop(void)
+{
+    CCTL1 = 0;
+    seq_state = SEQ_STOPPED;
+    seq_q_tail = seq_q_head; // nezahrany zvysok fronty sa zahodi
+    if (seq_note != VOICE_FREE)
+    {
+        voice_note_off(seq_note);
+        seq_note = VOICE_FREE;
+    }
+    task_signal(TASK_LCD); // riadok s hranym tonom sa vymaze
+}
+
+/**
+ * Spustenie prehravania z fronty bajtkodu. Dlzka tiku a tonu sa nenastavuju, prebera ich
+ * z bajtkodu vo fronte, takze po vyprazdneni a opatovnom naplneni fronty hra dalej v rovnakom tempe.
+ */
+void seq_play_queue(void)
+{
+    CCTL1 = 0;
+
+    seq_src = SEQ_SRC_QUEUE;
+    seq_wait = 0;
+    seq_note = VOICE_FREE;
+    seq_state = SEQ_PLAYING;
+
+    CCR1 = TAR + 1;
+    CCTL1 = CCIE;
+}
+
+// Pocet volnych bajtov vo fronte sekvencera
+unsigned char seq_queue_free(void)
+{
+    return (seq_q_tail - seq_q_head - 1) & SEQ_QUEUE_MASK;
+}
+
+/**
+ * Cakanie plniacej ulohy id na n volnych bajtov vo fronte, ulohu spusti krok sekvencera, ktory
+ * miesto uvolni (prerusenie Timer_A1). Miesto sa overi az po zapise seq_q_want, krok sekvencera
+ * medzi kontrolou v ulohe a zapisom teda signal nestrati.
+ */
+void seq_queue_wait(unsigned char id, unsigned char n)
+{
+    seq_q_waiter = id;
+    seq_q_want = n;
+    if (seq_queue_free() >= n)
+    {
+        seq_q_want = 0;
+        task_signal(id);
+    }
+}
+
+/**
+ * Zaradenie n bajtov (jedneho prikazu) do fronty sekvencera z hlavnej slucky. Prikaz sa zaradi
+ * cely alebo vobec, vracia pocet zaradenych bajtov (n alebo 0). Funkcia neceka: ulohy planovaca
+ * pred spracovanim vstupu overia miesto (seq_queue_free), pri plnej fronte skoncia a pokracuju
+ * pri dalsom spusteni. Zastaveny sekvencer sa spusti, aby sa fronta zacala prehravat.
+ */
+unsigned char seq_queue_put(const unsigned char *data, unsigned char n)
+{
+    unsigned char head = seq_q_head;
+    unsigned char i;
+
+    if (((seq_q_tail - head - 1) & SEQ_QUEUE_MASK) < n)
+    {
+        n = 0; // plna fronta nie je prazdna, zastaveny sekvencer sa nizsie spusti a uvolni ju
+    }
+    for (i = 0; i < n; i++)
+    {
+        seq_queue[head] = data[i];
+        head = (head + 1) & SEQ_QUEUE_MASK;
+    }
+    seq_q_head = head; // zverejnenie celeho prikazu naraz
+
+    if (seq_state == SEQ_STOPPED)
+    {
+        seq_play_queue();
+    }
+    return n;
+}
+
+// Nacitanie dalsieho bajtu skladby z aktualneho zdroja, prazdna fronta sa chape ako koniec skladby
+unsigned char seq_fetch(void)
+{
+    unsigned char cmd;
+
+    if (seq_src == SEQ_SRC_FLASH)
+    {
+        return *seq_pc++;
+    }
+    if (seq_q_tail == seq_q_head)
+    {
+        return SONG_END;
+    }
+    cmd = seq_queue[seq_q_tail];
+    seq_q_tail = (seq_q_tail + 1) & SEQ_QUEUE_MASK;
+    return cmd;
+}
+
+/**
+ * Jeden krok sekvencera volany z prerusenia CCR1 casovaca A.
+ * Ukonci predchadzajuci ton, spracuje riadiace prikazy az po najblizsi ton alebo pauzu
+ * a naplanuje dalsie prerusenie. Dlhe cakanie sa deli na useky, aby sa zmestilo do 16-bitoveho CCR1.
+ */
+void seq_step(void)
+{
+    unsigned char cmd;
+
+    if (seq_wait == 0)
+    {
+        task_signal(TASK_LCD); // novy ton alebo pauza na displeji
+        if (seq_note != VOICE_FREE) // koniec predchadzajuceho tonu
+        {
+            voice_note_off(seq_note);
+            seq_note = VOICE_FREE;
+        }
+
+        for (;;)
+        {
+            cmd = seq_fetch();
+
+            if (cmd < 0x80) // ton
+            {
+                voice_note_on(cmd);
+#ifdef STATS
+                stats_lat_start(STATS_LAT_SEQUENCER, CCR1);
+#endif
+                seq_note = cmd;
+                seq_wait = (unsigned long)seq_len * seq_tick;
+                break;
+            }
+            else if ((cmd & 0xC0) == 0x80) // pauza
+            {
+                seq_wait = (unsigned long)((cmd & 0x3F) + 1) * seq_tick;
+                break;
+            }
+            else if ((cmd & 0xE0) == 0xC0) // dlzka nasledujucich tonov
+            {
+                seq_len = (cmd & 0x1F) + 1;
+            }
+            else if (cmd == SONG_CMD_TEMPO) // dlzka tiku skladby
+            {
+                seq_tick = seq_fetch();
+                seq_tick |= (unsigned int)seq_fetch() << 8;
+            }
+            else if (cmd == SONG_CMD_LEN) // dlzka nasledujucich tonov nad 32 tikov
+            {
+                seq_len = seq_fetch();
+            }
+            else // SONG_END, neznamy prikaz skladbu tiez ukonci
+            {
+                seq_stop();
+                return;
+            }
+        }
+    }
+
+    if (seq_wait > SEQ_MAX_WAIT)
+    {
+        CCR1 += SEQ_MAX_WAIT;
+        seq_wait -= SEQ_MAX_WAIT;
+    }
+    else
+    {
+        CCR1 += (unsigned int)seq_wait;
+        seq_wait = 0;
+    }
+}
+
+void play_demo()
+{
+    seq_play(demo_song);
+}
+
+// Prehranie skladby z tabulky skladieb s vypisom nazvu na displej
+void song_play(unsigned char index)
+{
+    song_current = index;
+    seq_feed_stop();
+    lcd_print_label(LCD_LINE_STATUS, "Hra: ", songs[index].name);
+    seq_play(songs[index].data);
+}
+
+// Prerusenie od CCR1 a CCR2 casovaca A - krok sekvencera skladby a budenie planovaca v termine ulohy
+interrupt (TIMERA1_VECTOR) Timer_A1 (void)
+{
+#ifdef STATS
+    unsigned int start = TAR;
+#endif
+
+    switch (TAIV)
+    {
+        case 2: // prerusenie od CCR1 - krok sekvencera
+            seq_step();
+            if (seq_q_want && (seq_queue_free() >= seq_q_want))
+            {
+                seq_q_want = 0;
+                task_signal(seq_q_waiter);
+            }
+#ifdef STATS
+            stats_time(&stats_seq, TAR_SINCE(start));
+#endif
+            _BIC_SR_IRQ(LPM3_bits); // krok mohol signalizovat plniacu ulohu, displej alebo NCO
+            break;
+
+        case 4: // prerusenie od CCR2 - termin ulohy, dalsi nastavi planovac
+            CCTL2 = 0;
+            _BIC_SR_IRQ(LPM3_bits);
+            break;
+    }
+}
+
+/**
+ * Vygenerovanie jedneho bloku vzoriek do buf.
+ * Hlasy sa spracuvaju postupne (faza a prirastok hlasu zostavaju v registroch pocas celeho bloku),
+ * na zaciatku bloku sa prepocita obalka hlasu a tiche hlasy sa preskocia. Na vzorku a hlas pripada
+ * jedno citanie z tabulky oktavy a jedno nasobenie 8 x 8 bitov urovnou hlasu (pozri HLASITOST).
+ * Na konci sa sucet posunie o MIX_SHIFT a saturuje na rozsah DA prevodnika.
+ */
+unsigned char audio_render(unsigned int *buf)
+{
+    unsigned char i, n, vol, active = 0;
+    unsigned int mix;
+    unsigned long phase, phase_inc;
+    const unsigned char *wave;
+    voice_t *v;
+
+    for (n = 0; n < AUDIO_BLOCK; n++)
+    {
+        buf[n] = 0;
+    }
+
+    for (i = 0, v = voices; i < VOICES; i++, v++)
+    {
+        voice_latch(v);
+        if (v->env_state == ENV_IDLE)
+        {
+            continue;
+        }
+        active++;
+
+        // obalka sa prepocita raz za blok a urci hlasitost hlasu pre cely blok
+        vol = env_update(v);
+        if (vol == 0)
+        {
+            continue;
+        }
+        wave = v->wave;
+
+        // posun fazy hlasu o prirastok jeho tonu, najvyssie bity fazy vyberaju vzorku signalu
+        phase = v->phase;
+        phase_inc = v->phase_inc;
+        for (n = 0; n < AUDIO_BLOCK; n++)
+        {
+            phase = (phase + phase_inc) & 0xFFFFFFFFUL; // 32-bitova faza aj pri 64-bitovom long
+            buf[n] += (unsigned int)wave[(unsigned int)(phase >> 16) >> (16 - WAVE_BITS)] * vol;
+        }
+        v->phase = phase;
+    }
+
+    for (n = 0; n < AUDIO_BLOCK; n++)
+    {
+        mix = buf[n] >> MIX_SHIFT;
+        if (mix > DAC_MAX) // saturacia suctu hlasov
+        {
+            mix = DAC_MAX;
+        }
+        buf[n] = mix;
+    }
+    return active;
+}
+
+#ifdef AUDIO_PWM
+/**
+ * Prevod bloku vzoriek z konca buffra buf (AUDIO_BLOCK vzoriek 0 az DAC_MAX) na dlzky impulzov PWM
+ * od zaciatku buffra, kazda vzorka na PWM_OVERSAMPLE period. Zapis nepredbehne citanie, vzorka sa
+ * precita skor, nez sa prepise. Dlzka impulzu je vzorka * pwm_period / 2^DAC_BITS, s AUDIO_PWM_NS
+ * sa k nej pricita chyba zaokruhlenia predchadzajucej periody (sigma-delta 1. radu).
+ */
+void pwm_convert(unsigned int *buf)
+{
+    const unsigned int *in = buf + AUDIO_OUT_BLOCK - AUDIO_BLOCK;
+    unsigned long level;
+    unsigned char n, k;
+#ifdef AUDIO_PWM_NS
+    unsigned int error = pwm_error;
+#endif
+
+    for (n = 0; n < AUDIO_BLOCK; n++)
+    {
+        level = (unsigned long)in[n] * pwm_period; // dlzka impulzu s DAC_BITS desatinnymi bitmi
+        for (k = 0; k < PWM_OVERSAMPLE; k++)
+        {
+#ifdef AUDIO_PWM_NS
+            *buf++ = (level + error) >> DAC_BITS;
+            error = (level + error) & DAC_MAX;
+#else
+            *buf++ = level >> DAC_BITS;
+#endif
+        }
+    }
+#ifdef AUDIO_PWM_NS
+    pwm_error = error;
+#endif
+}
+#endif
+
+/**
+ * Zapnutie zvukoveho vystupu: reference, DA prevodnik (pri AUDIO_PWM vyvod TB1), DMA a casovac B.
+ * Pocas AUDIO_WARMUP_BLOCKS blokov sa vystupuje ticho, kym sa neustali referencne napatie.
+ */
+void audio_start(void)
+{
+    unsigned char n;
+
+#ifndef AUDIO_PWM
+    ADC12CTL0 |= 0x0020;    // nastavenie refeencneho napetia na 1,5 V, je mozne ist az na 2,5V.
+    DAC12_0CTL |= 0x0060;   // nastavenie kontrolneho registra DAC (na 12-bitovy rezim kvoli suctu hlasov, medium speed)
+    DAC12_0CTL |= 0x100;    // referencne napeti nasobit 1x, podla dokumentacie je mozne nasobit referencne napetie aj 3x, co myslim ze tu nepotrebujem
+#else
+    TBCCR1 = 0;
+    TBCCTL1 = OUTMOD_7 + CLLD_1; // PWM reset/set, TBCL1 sa nacita pri TBR = 0
+    P4SEL |= PWM_PIN;            // vyvod P4.1 riadi TB1
+    P4DIR |= PWM_PIN;
+#ifdef AUDIO_PWM_NS
+    pwm_error = 0;
+#endif
+#endif
+
+    audio_half = 0;
+    audio_warmup = AUDIO_WARMUP_BLOCKS;
+    audio_silent = 0;
+    for (n = 0; n < AUDIO_OUT_BLOCK; n++)
+    {
+        audio_buf[0][n] = 0;
+        audio_buf[1][n] = 0;
+    }
+    audio_on = 1;
+
+    DMACTL0 = DMA0TSEL_2; // spustac DMA kanalu 0 je TBCCR2 CCIFG
+    DMA0SA = (uintptr_t)audio_buf[0];
+    DMA0DA = (uintptr_t)&AUDIO_OUT_REG;
+    DMA0SZ = AUDIO_OUT_BLOCK;
+    DMA0CTL = DMADT_0 + DMASRCINCR_3 + DMADSTINCR_0 + DMAIE + DMAEN; // jednotlive prenosy slov, zdroj sa inkrementuje
+
+#if defined(AUDIO_PWM)
+    TBCCR0 = pwm_period - 1;         // perioda nosnej PWM, poziadavka pre DMA PWM_OVERSAMPLE krat za vzorku
+    TBCCR2 = 0;
+    TBCTL = TBSSEL_2 + MC_1 + TBCLR; // SMCLK, rezim UP
+#elif defined(AUDIO_SMCLK)
+    TBCCR0 = audio_period - 1;       // perioda vzorkovania namerana pri starte
+    TBCCR2 = 0;                      // poziadavka pre DMA raz za periodu
+    TBCTL = TBSSEL_2 + MC_1 + TBCLR; // SMCLK, rezim UP
+#else
+    TBCCR0 = AUDIO_SAMPLE_TICKS - 1; // perioda vzorkovania
+    TBCCR2 = 0;                      // poziadavka pre DMA raz za periodu
+    TBCTL = TBSSEL_1 + MC_1 + TBCLR; // ACLK, rezim UP
+#endif
+}
+
+// Vypnutie zvukoveho vystupu v tichu (volane z prerusenia DMA)
+void audio_stop(void)
+{
+    TBCTL = TBCLR;          // zastavenie casovaca B
+    DMA0CTL = 0;
+#ifndef AUDIO_PWM
+    DAC12_0CTL &= ~0x00E0;  // vypnutie zosilnovacov DAC (vystup v stave vysokej impedancie)
+    ADC12CTL0 &= ~0x0020;   // vypnutie referencneho napatia
+#else
+    TBCCTL1 = 0;            // vystup TB1 v log. 0
+    P4SEL &= ~PWM_PIN;      // vyvod drzi log. 0 ako port
+#endif
+    audio_on = 0;
+}
+
+/**
+ * Uspanie hlavnej slucky do najblizsieho prerusenia, ktore ju budi (termin CCR2, sekvencer, klavesnica).
+ * Prerusenia sa povolia az spolu so spankom, volat sa ma so zakazanymi preruseniami.
+ * Pri zapnutom zvuku a v okne SLEEP_TERM_IDLE_S po prikaze terminalu sa spi v LPM0 (pozri
+ * VYPINANIE ZVUKU V TICHU).
+ */
+void cpu_sleep(void)
+{
+#ifdef STATS
+    unsigned int start = TAR;
+#endif
+
+    if (audio_on)
+    {
+        sleep_active = sys_time; // okno LPM0 plynie az od konca zvuku
+        _BIS_SR(LPM0_bits + GIE);
+    }
+#ifndef SLEEP_LPM0
+    else if ((sys_time - sleep_active >= SLEEP_TERM_IDLE_TICKS) && (mel_input_state == MEL_INPUT_NONE))
+    {
+        _BIS_SR(LPM3_bits + GIE);
+#ifdef STATS
+        stats_sleep_lpm3 += TAR_SINCE(start);
+#endif
+    }
+#endif
+    else
+    {
+        _BIS_SR(LPM0_bits + GIE);
+    }
+
+#ifdef STATS
+    stats_sleep += TAR_SINCE(start);
+#endif
+}
+
+// Oznacenie ulohy za pripravenu, mozne aj z prerusenia (to potom musi prebudit hlavnu slucku)
+void task_signal(unsigned char id)
+{
+#ifdef STATS
+    if (!tasks[id].ready)
+    {
+        stats_task_stamp[id] = TAR;
+    }
+#endif
+    tasks[id].ready = 1;
+}
+
+// Naplanovanie ulohy o ticks tikov ACLK (iba z hlavnej slucky)
+void task_at(unsigned char id, unsigned int ticks)
+{
+    tasks[id].deadline = TAR + ticks;
+    tasks[id].timed = 1;
+}
+
+/**
+ * Planovac uloh, nekonci. V jednom prechode spusti kazdu pripravenu ulohu a ulohu, ktorej nastal
+ * termin, a kym nejaka bezala, prechod sa opakuje. Potom nastavi CCR2 na najblizsi termin a uspi CPU.
+ * Periodicka uloha, ktora nestihla termin, sa nespusta viackrat za sebou, jej dalsi termin sa
+ * pocita od aktualneho casu. Terminal je periodicky, CPU sa teda budi aspon raz za jeho periodu
+ * a sys_time nepretecie medzi dvoma prechodmi.
+ */
+void sched_run(void)
+{
+    unsigned char i, ran, signaled, due, wait;
+    unsigned int now, left, next_left, next = 0, last = TAR;
+    task_t *t;
+#ifdef STATS
+    unsigned int start, since, run;
+#endif
+
+    while (1)
+    {
+        now = TAR;
+        sys_time += (now - last) & 0xFFFF;
+        last = now;
+
+        ran = 0;
+        for (i = 0, t = tasks; i < TASKS; i++, t++)
+        {
+            signaled = t->ready;
+            left = TASK_LEFT(t->deadline, now);
+            due = t->timed && ((left & 0x8000) || (left < TASK_MIN_LEFT));
+            if (!signaled && !due)
+            {
+                continue;
+            }
+
+#ifdef STATS
+            // odozva sa meria od terminu alebo od signalu
+            since = due ? ((left & 0x8000) ? t->deadline : now) : stats_task_stamp[i];
+            start = TAR;
+#endif
+            t->ready = 0;
+            if (due)
+            {
+                if (t->period)
+                {
+                    t->deadline += t->period;
+                    if (TASK_LEFT(t->deadline, now) & 0x8000)
+                    {
+                        t->deadline = now + t->period; // nestihnute periody sa vynechaju
+                    }
+                }
+                else
+                {
+                    t->timed = 0;
+                }
+            }
+
+            t->run();
+            ran = 1;
+
+#ifdef STATS
+            run = TAR_SINCE(start);
+            if (run > stats_task_run[i])
+            {
+                stats_task_run[i] = run;
+            }
+            run = TAR_SINCE(since);
+            if (run > stats_task_resp[i])
+            {
+                stats_task_resp[i] = run;
+            }
+            stats_task_count[i]++;
+#endif
+        }
+        if (ran)
+        {
+            continue; // ulohy mohli oznacit ine ulohy za pripravene
+        }
+
+        // signal alebo termin medzi kontrolou a uspanim nesmie zostat nepovsimnuty
+        dint();
+        now = TAR;
+        wait = 1;
+        next_left = 0xFFFF; // ziadny termin
+        for (i = 0, t = tasks; i < TASKS; i++, t++)
+        {
+            left = TASK_LEFT(t->deadline, now);
+            if (t->ready || (t->timed && ((left & 0x8000) || (left < TASK_MIN_LEFT))))
+            {
+                wait = 0;
+            }
+            else if (t->timed && (left < next_left))
+            {
+                next_left = left;
+                next = t->deadline;
+            }
+        }
+        if (!wait)
+        {
+            eint();
+            continue;
+        }
+
+        CCR2 = next;
+        CCTL2 = (next_left != 0xFFFF) ? CCIE : 0;
+#ifdef STATS
+        stats_wakeups++;
+#endif
+        cpu_sleep();
+    }
+}
+
+/**
+ * Prerusenie DMA po odoslani celeho buffra. DMA sa hned prepne na druhy (uz vygenerovany) buffer,
+ * aby nevypadla ziadna vzorka, a do dohraneho buffra sa vygeneruje dalsi blok. Generovanie bezi
+ * s povolenymi preruseniami, aby neblokovalo terminal ani sekvencer. Sekvencer parametre hlasov
+ * iba zverejnuje (voice_publish), generator ich preberie az pred dalsim blokom.
+ * Pocas generovania je zamaskovane iba prerusenie DMA (DMAIE), generator sa teda do seba nevnori
+ * ani pri pretazeni. Ak DMA medzitym dohra aj druhy buffer, zostane nastaveny DMAIFG (nestihnuty
+ * blok, STATS ho zapocita), kanal stoji a po odmaskovani sa prerusenie vyvola hned znova.
+ * Oneskorenie tonu (STATS) sa zapocita, ked DMA zacne odosielat blok, v ktorom bol ton vygenerovany.
+ */
+interrupt (DACDMA_VECTOR) Audio_DMA (void)
+{
+    unsigned char i, done, active;
+#ifdef STATS
+    unsigned int start = TAR;
+    unsigned char lat;
+#endif
+
+    if (!(DMA0CTL & DMAIFG))
+    {
+        return;
+    }
+    DMA0CTL &= ~DMAIFG;
+
+    done = audio_half;
+    audio_half ^= 1;
+    DMA0SA = (uintptr_t)audio_buf[audio_half];
+    DMA0SZ = AUDIO_OUT_BLOCK;
+    DMA0CTL |= DMAEN;
+#ifdef STATS
+    if (stats_lat_rendered)
+    {
+        stats_lat_done(stats_lat_rendered);
+        stats_lat_rendered = 0;
+    }
+    lat = stats_lat_pending; // tony zadane pocas generovania sa prevezmu az do dalsieho bloku
+#endif
+
+    if (audio_warmup)
+    {
+        // buffer obsahuje ticho z audio_start, hlasy cakaju na ustalenie reference
+        audio_warmup--;
+        return;
+    }
+
+    // vzorky sa generuju na koniec buffra, pri PWM ich pwm_convert prevedie od zaciatku buffra
+    DMA0CTL &= ~DMAIE;
+    eint();
+    active = audio_render(audio_buf[done] + AUDIO_OUT_BLOCK - AUDIO_BLOCK);
+#ifdef AUDIO_PWM
+    pwm_convert(audio_buf[done]);
+#endif
+    dint();
+    DMA0CTL |= DMAIE;
+
+    // po dvoch tichych blokoch su oba buffre tiche a vystup sa moze vypnut, ak ziaden hlas
+    // necaka na prevzatie tonu zverejneneho pocas generovania
+    if (active)
+    {
+        audio_silent = 0;
+    }
+    else if (++audio_silent >= 2)
+    {
+        for (i = 0; (i < VOICES) && (voices[i].latched == voices[i].seq); i++);
+        if (i == VOICES)
+        {
+            audio_stop();
+        }
+    }
+
+#ifdef STATS
+    stats_time(&stats_render, TAR_SINCE(start));
+    if (DMA0CTL & DMAIFG)
+    {
+        stats_missed++;
+    }
+    if (active)
+    {
+        stats_lat_rendered = lat;
+        stats_lat_pending &= ~lat;
+    }
+#endif
+}
+
+#ifdef STATS
+// Zapocitanie jedneho merania casu
+void stats_time(stats_time_t *t, unsigned int ticks)
+{
+    if ((t->count == 0) || (ticks < t->min))
+    {
+        t->min = ticks;
+    }
+    if (ticks > t->max)
+    {
+        t->max = ticks;
+    }
+    t->sum += ticks;
+    t->count++;
+}
+
+// Vynulovanie statistik, prerusenia ich menia, preto sa nuluju so zakazanymi preruseniami
+void stats_reset(void)
+{
+    unsigned char i, bin;
+
+    dint();
+    stats_render.count = 0;
+    stats_render.max = 0;
+    stats_render.sum = 0;
+    stats_seq.count = 0;
+    stats_seq.max = 0;
+    stats_seq.sum = 0;
+    stats_missed = 0;
+    for (i = 0; i < STATS_LAT_PATHS; i++)
+    {
+        for (bin = 0; bin < STATS_LAT_BINS; bin++)
+        {
+            stats_lat[i][bin] = 0;
+        }
+        stats_lat_max[i] = 0;
+    }
+    stats_lat_pending = 0;
+    stats_lat_rendered = 0;
+    for (i = 0; i < TASKS; i++)
+    {
+        stats_task_resp[i] = 0;
+        stats_task_run[i] = 0;
+        stats_task_count[i] = 0;
+    }
+    stats_wakeups = 0;
+    stats_sleep = 0;
+    stats_sleep_lpm3 = 0;
+    stats_start = sys_time;
+    eint();
+}
+
+// Zaciatok merania oneskorenia tonu zadaneho cestou path v case stamp (TAR)
+void stats_lat_start(unsigned char path, unsigned int stamp)
+{
+    stats_lat_stamp[path] = stamp;
+    stats_lat_pending |= 1 << path;
+}
+
+/**
+ * Zapocitanie oneskorenia ciest v bitovej maske paths (volane z prerusenia DMA na zaciatku odosielania
+ * bloku s ich tonmi). Skupiny histogramu maju dvojnasobnu sirku intervalu oproti predchadzajucej,
+ * interval sa teda urci posunom bez delenia.
+ */
+void stats_lat_done(unsigned char paths)
+{
+    unsigned char path, bin, shift;
+    unsigned int ticks, low;
+
+    for (path = 0; path < STATS_LAT_PATHS; path++)
+    {
+        if (!(paths & (1 << path)))
+        {
+            continue;
+        }
+        ticks = TAR_SINCE(stats_lat_stamp[path]);
+        for (bin = 0, low = 0, shift = STATS_LAT_SHIFT;
+             (bin < STATS_LAT_BINS - STATS_LAT_SUB) && (ticks - low >= ((unsigned int)STATS_LAT_SUB << shift));
+             bin += STATS_LAT_SUB, shift++)
+        {
+            low += STATS_LAT_SUB << shift;
+        }
+        bin += ((ticks - low) >> shift < STATS_LAT_SUB) ? (ticks - low) >> shift : STATS_LAT_SUB - 1;
+        stats_lat[path][bin]++;
+        if (ticks > stats_lat_max[path])
+        {
+            stats_lat_max[path] = ticks;
+        }
+    }
+}
+#endif
+
+/**
+ * Zapis najnovsieho drzaneho tonu do NCO v FPGA, po SPI sa zapisuje iba pri zmene tonu.
+ * Drzane tony sa urcia zo zverejnenych parametrov hlasov (generator vzoriek s NCO nebezi).
+ */
+void nco_idle(void)
+{
+    unsigned char i, sel = VOICE_FREE;
+    unsigned long inc;
+
+    for (i = 0; i < VOICES; i++)
+    {
+        if (!VOICE_PARAM(&voices[i])->gate)
+        {
+            continue;
+        }
+        if ((sel == VOICE_FREE) || !((unsigned int)(voices[i].age - voices[sel].age) & 0x8000))
+        {
+            sel = i;
+        }
+    }
+    if (sel != VOICE_FREE)
+    {
+        sel = voices[sel].note;
+    }
+    if (sel == nco_note)
+    {
+        return;
+    }
+
+    if (sel == VOICE_FREE)
+    {
+        FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, NCO_ADDR_VOLUME, 0);
+    }
+    else
+    {
+        inc = (note_to_inc(sel) + NCO_INC_DIV / 2) / NCO_INC_DIV;
+        FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, NCO_ADDR_INC_LO, inc & 0xFFFF);
+        FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, NCO_ADDR_INC_HI, inc >> 16);
+        FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, NCO_ADDR_VOLUME, (255 * volume) / VOLUME_MAX);
+    }
+    nco_note = sel;
+}
+
+// Zapis riadku do tienovej pamate displeja, zvysok riadku sa doplni medzerami
+void lcd_print(unsigned char line, const char *text)
+{
+    unsigned char i;
+    char c;
+
+    for (i = 0; i < LCD_CHARS; i++)
+    {
+        c = *text ? *text++ : ' ';
+        lcd_dirty |= (lcd_text[line][i] != c);
+        lcd_text[line][i] = c;
+    }
+    if (lcd_dirty)
+    {
+        task_signal(TASK_LCD);
+    }
+}
+
+// Zapis popisu a nazvu do riadku displeja, dlhy nazov sa skrati
+void lcd_print_label(unsigned char line, const char *label, const char *name)
+{
+    unsigned char i;
+    char c;
+
+    for (i = 0; i < LCD_CHARS; i++)
+    {
+        c = *label ? *label++ : (*name ? *name++ : ' ');
+        lcd_dirty |= (lcd_text[line][i] != c);
+        lcd_text[line][i] = c;
+    }
+    if (lcd_dirty)
+    {
+        task_signal(TASK_LCD);
+    }
+}
+
+// Zapis nazvu tonu (napr. "C#4") do text, vrati pocet znakov
+unsigned char note_name(unsigned char note, char *text)
+{
+    unsigned char pos = 0;
+
+    text[pos++] = note_names[note % 12][0];
+    if (note_names[note % 12][1] != ' ')
+    {
+        text[pos++] = note_names[note % 12][1];
+    }
+    text[pos++] = '0' + note / 12 - 1;
+    return pos;
+}
+
+/**
+ * Uloha TASK_LCD: aktualizuje riadok s prave hranym tonom skladby a zmeneny obsah prenesie
+ * do znakovej pamate v FPGA jednym blokovym prenosom. Spusta ju lcd_print pri zmene textu
+ * a krok sekvencera pri novom tone, pauze alebo zastaveni.
+ */
+void lcd_idle(void)
+{
+    unsigned char i;
+    unsigned char data[LCD_LINES * LCD_CHARS];
+    unsigned char playing = (seq_state == SEQ_PLAYING) ? seq_note : LCD_NOT_PLAYING;
+    char text[LCD_CHARS + 1];
+
+    if (!lcd_ready)
+    {
+        return;
+    }
+
+    if (playing != lcd_playing)
+    {
+        lcd_playing = playing;
+        i = 0;
+        if (playing != LCD_NOT_PLAYING)
+        {
+            text[i++] = 'H'; text[i++] = 'r'; text[i++] = 'a'; text[i++] = ':'; text[i++] = ' ';
+            if (playing == VOICE_FREE) // pauza
+            {
+                text[i++] = '-';
+            }
+            else
+            {
+                i += note_name(playing, text + i);
+            }
+        }
+        text[i] = 0;
+        lcd_print(LCD_LINE_PLAYING, text);
+    }
+
+    if (!lcd_dirty)
+    {
+        return;
+    }
+    lcd_dirty = 0;
+
+    // kopia, blokovy prenos moze do buffra zapisat prijate data
+    for (i = 0; i < LCD_LINES * LCD_CHARS; i++)
+    {
+        data[i] = lcd_text[i / LCD_CHARS][i % LCD_CHARS];
+    }
+    FPGA_SPI_RW_AN_DN(SPI_FPGA_ENABLE_WRITE, LCD_FB_ADDR_DATA, data, 1, sizeof(data));
+}
+
+void print_user_help(void)
+{         
+	term_send_str_crlf("Ovladanie hudnobneho simulatoru");
+	term_send_str_crlf("Ovladanie klavesnice");
+	
+    // jednociarkova oktava
+	term_send_str_crlf(">-klavesa '1' zahra ton C4(c')");
+	term_send_str_crlf(">-klavesa '2' zahra ton D4(d')");
+	term_send_str_crlf(">-klavesa '3' zahra ton E4(e')");
+	term_send_str_crlf(">-klavesa 'A' zahra ton F4(f')");
+	term_send_str_crlf(">-klavesa '4' zahra ton G4(g')");
+	term_send_str_crlf(">-klavesa '5' zahra ton A4(a')");
+	term_send_str_crlf(">-klavesa '6' zahra ton B4(h')");
+	
+    // dvojciarkova oktava
+	term_send_str_crlf(">-klavesa '7' zahra ton C5(c'')");
+	term_send_str_crlf(">-klavesa '8' zahra ton D5(d'')");
+	term_send_str_crlf(">-klavesa '9' zahra ton E5(e'')");
+	term_send_str_crlf(">-klavesa 'C' zahra ton F5(f'')");
+	term_send_str_crlf(">-klavesa '*' zahra ton G5(g'')");
+	term_send_str_crlf(">-klavesa '0' zahra ton A5(a'')");
+	term_send_str_crlf(">-klavesa '#' zahra ton B5(h'')");
+	 
+	// song
+	term_send_str_crlf(">-klavesa 'D' a prehra demo (alebo naposledy vybranu) skladbu, dalsie stlacenie 'D' skladbu zastavi");
+	term_send_str_crlf(">-klavesa 'B' prepne nastroj (klarinet, flauta, organ, obdlznik)");
+
+
+	term_send_str_crlf("Ovladanie terminalom");
+	term_send_str_crlf(">-zadaj ton ako pismeno A-G, posuvku '#' alebo 'b' a oktavu 0-7 (napr. 'C4', 'F#5', 'Bb3')");
+	 
+	// song
+	term_send_str_crlf(">-zadaj prikaz 'DEMO' a prehra demo skladbu");
+	term_send_str_crlf(">-zadaj prikaz 'STOP' a prehravanie skladby sa zastavi");
+	term_send_str_crlf(">-zadaj prikaz 'STREAM' a posielaj riadky melodie, riadok 'END' prijem ukonci (terminal s XON/XOFF)");
+	term_send_str_crlf(">-zadaj prikaz 'RAM PLAY' a prehra skladbu nahratu do FPGA (nahranie: 'RAM NEW' a riadky 'RAM <hex>')");
+	term_send_str_crlf(">-zadaj prikaz 'SONG' pre zoznam skladieb, 'SONG 2' alebo 'SONG nazov' skladbu prehra");
+	term_send_str_crlf(">-zadaj prikaz 'INST' pre zoznam nastrojov, 'INST 2' alebo 'INST flauta' vyberie nastroj");
+#ifdef STATS
+	term_send_str_crlf(">-zadaj prikaz 'STATS' a vypisu sa statistiky behu od posledneho vypisu");
+#endif
+	term_send_str_crlf(">-zadaj prikaz 'PLAY T120 C4/4 D4/8 R/8 F#5/2.' a zahra sa zadana melodia");
+	term_send_str_crlf("  Tn tempo, ton A-G, posuvka #/b, oktava 0-7, /d dlzka 1/d noty, '.' bodka, R pauza");
+}
+
+// Incializacia periferii
+void fpga_initialized()
+{ 
+    unsigned char i;
+
+    // FPGA po konfiguracii displej inicializuje samo, znakova pamet sa prepise cela
+    FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, LCD_FB_ADDR_POS, 0);
+    for (i = 0; i < LCD_LINES * LCD_CHARS; i++)
+    {
+        lcd_text[i / LCD_CHARS][i % LCD_CHARS] = ' ';
+    }
+    lcd_dirty = 1;
+    lcd_ready = 1;
+    lcd_print(LCD_LINE_STATUS, "Simulator hudby");
+	
+    // poslanie infa do terminalu
+    term_send_str_crlf(" ");   
+    term_send_str_crlf("SIMULATOR HUDBY POMOCOU DA PREVODNIKA");
+    term_send_str_crlf("Napetie je generovane na 0. kanálu DA prevodniku mikrokontrolera.");
+    term_send_str_crlf("Prosim pripojte svoj reproduktor na pin c. 31 JP9 pinoveho pola a GND pin");
+    term_send_str_crlf("Ovladanie je mozne pomocou klavesnice aj terminalu");
+    term_send_str_crlf("Napiste 'help' pre popis ovladania");
+
+}
+
+/**
+ * Dekodovanie tonu z textu prikazu: pismeno A-G, volitelna posuvka '#' alebo 'b' a oktava 0-7 (napr. "F#5", "Bb3").
+ * Cislo tonu sa pocita priamo z pismena, posuvky a oktavy, text musi koncit za oktavou.
+ * Vrati 1 a zapise MIDI cislo do note, ak ide o platny ton z rozsahu tabulky.
+ */
+unsigned char note_decode(const char *text, unsigned char *note)
+{
+    unsigned char c = *text++ | 0x20; // male pismeno
+    signed char acc = 0;
+
+    if ((c < 'a') || (c > 'g'))
+    {
+        return 0;
+    }
+    if ((*text == '#') || (*text == 'b'))
+    {
+        acc = (*text++ == '#') ? 1 : -1;
+    }
+    if ((*text < '0') || (*text > '7') || (text[1] != 0))
+    {
+        return 0;
+    }
+
+    c = MIDI_NOTE(mel_tones[c - 'a'], *text - '0') + acc;
+    if ((c < NOTE_FIRST) || (c > NOTE_LAST))
+    {
+        return 0;
+    }
+    *note = c;
+    return 1;
+}
+
+/**
+ * Zahranie tonov (akordu) na NOTES_PLAY_MS s popisom na displeji. Tony ukonci uloha TASK_NOTES_OFF,
+ * terminal teda necaka. Tony predchadzajuceho prikazu sa ukoncia hned.
+ */
+void notes_play(const unsigned char *notes, unsigned char count, char *text)
+{
+    unsigned char i;
+
+    notes_release();
+    lcd_print(LCD_LINE_STATUS, text);
+
+    // vsetky tony znia naraz, z viac ako VOICES tonov by aj tak zneli iba posledne
+    if (count > VOICES)
+    {
+        notes += count - VOICES;
+        count = VOICES;
+    }
+    for (i = 0; i < count; i++)
+    {
+        note_on(notes[i]);
+        notes_held[i] = notes[i];
+    }
+    notes_held_count = count;
+    task_at(TASK_NOTES_OFF, TASK_TICKS_MS(NOTES_PLAY_MS));
+}
+
+// Uloha TASK_NOTES_OFF - ukoncenie tonov zahranych z terminalu
+void notes_release(void)
+{
+    while (notes_held_count)
+    {
+        note_off(notes_held[--notes_held_count]);
+    }
+}
+
+void cmd_demo(char *args)
+{
+    (void)args;
+    lcd_print(LCD_LINE_STATUS, "Hra DEMO skladba");
+    seq_feed_stop();
+    play_demo();
+}
+
+void cmd_stop(char *args)
+{
+    (void)args;
+    lcd_print(LCD_LINE_STATUS, "Stop skladby");
+    seq_feed_stop();
+    seq_stop();
+}
+
+// Ukoncenie plnenia fronty sekvencera (melodia z terminalu, skladba z FPGA)
+void seq_feed_stop(void)
+{
+    mel_input_reset();
+    song_ram_play = 0;
+}
+
+/**
+ * Prikaz RAM: bez argumentu vypise obsadenie pamate skladieb v FPGA, RAM NEW ju vyprazdni,
+ * RAM PLAY prehra nahratu skladbu a RAM s hexadecimalnymi bajtmi (parny pocet, najviac SONG_RAM_LINE)
+ * ich zapise za doteraz nahrate bajty jednym prenosom.
+ */
+void cmd_ram(char *args)
+{
+    unsigned char data[SONG_RAM_LINE];
+    unsigned char n = 0, digits = 0, nibble;
+
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    if (*args == 0)
+    {
+        term_send_str("Pamat skladieb v FPGA: ");
+        term_send_num(song_ram_size);
+        term_send_str(" z ");
+        term_send_num(SONG_RAM_BYTES);
+        term_send_str(" bajtov");
+        term_send_crlf();
+        return;
+    }
+    if (name_equal("NEW", args))
+    {
+        song_ram_size = 0;
+        return;
+    }
+    if (name_equal("PLAY", args))
+    {
+        if (mel_input_state != MEL_INPUT_NONE)
+        {
+            term_send_str("Predchadzajuca melodia sa este spracuva");
+            term_send_crlf();
+            return;
+        }
+        if (song_ram_size == 0)
+        {
+            term_send_str("Pamat skladieb v FPGA je prazdna");
+            term_send_crlf();
+            return;
+        }
+        if (seq_state == SEQ_PLAYING)
+        {
+            seq_stop();
+        }
+        lcd_print(LCD_LINE_STATUS, "Hra skladba FPGA");
+        song_ram_pos = 0;
+        song_ram_play = 1;
+        task_signal(TASK_SONG_RAM);
+        return;
+    }
+
+    // hexadecimalne bajty, medzery medzi bajtmi su volitelne
+    for (; *args; args++)
+    {
+        if (*args == ' ')
+        {
+            continue;
+        }
+        nibble = *args | 0x20;
+        if ((nibble >= '0') && (nibble <= '9'))
+        {
+            nibble -= '0';
+        }
+        else if ((nibble >= 'a') && (nibble <= 'f'))
+        {
+            nibble -= 'a' - 10;
+        }
+        else
+        {
+            n = SONG_RAM_LINE + 1; // chyba
+            break;
+        }
+        if (n == SONG_RAM_LINE)
+        {
+            n++;
+            break;
+        }
+        data[n] = (digits & 1) ? ((data[n] << 4) | nibble) : nibble;
+        n += digits & 1;
+        digits++;
+    }
+    if ((n > SONG_RAM_LINE) || (digits & 1) || (n & 1))
+    {
+        term_send_str("Chybne data: parny pocet hexadecimalnych bajtov, najviac ");
+        term_send_num(SONG_RAM_LINE);
+        term_send_crlf();
+        return;
+    }
+    if (song_ram_size + n > SONG_RAM_BYTES)
+    {
+        term_send_str("Pamat skladieb v FPGA je plna");
+        term_send_crlf();
+        return;
+    }
+
+    FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, SONG_RAM_ADDR_PTR, song_ram_size / 2);
+    FPGA_SPI_RW_AN_DN(SPI_FPGA_ENABLE_WRITE, SONG_RAM_ADDR_DATA, data, 1, n);
+    song_ram_size += n;
+}
+
+/**
+ * Uloha TASK_SONG_RAM - citanie skladby z pamate v FPGA do fronty sekvencera. Blok sa precita,
+ * iba ak sa cely zmesti do fronty, inak uloha skonci a znova ju spusti sekvencer (seq_queue_wait).
+ * Ukazatel sa nastavuje pred kazdym blokom, medzitym ho mohol zmenit prikaz RAM. Citanie skonci
+ * bajtom SONG_END alebo koncom nahratych dat.
+ */
+void song_ram_task(void)
+{
+    unsigned char data[SONG_RAM_BURST * 2];
+    unsigned char n, i;
+
+    while (song_ram_play && (seq_queue_free() >= sizeof(data)))
+    {
+        if (song_ram_pos >= song_ram_size)
+        {
+            data[0] = SONG_END;
+            song_ram_play = !seq_queue_put(data, 1);
+            break;
+        }
+
+        FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_WRITE, SONG_RAM_ADDR_PTR, song_ram_pos / 2);
+        FPGA_SPI_RW_AN_DN(SPI_FPGA_ENABLE_READ, SONG_RAM_ADDR_DATA, data, 1, sizeof(data));
+
+        n = (song_ram_size - song_ram_pos < sizeof(data)) ? song_ram_size - song_ram_pos : sizeof(data);
+        for (i = 0; (i < n) && (data[i] != SONG_END); i++);
+        if (i < n) // koniec skladby
+        {
+            n = i + 1;
+        }
+        if (!seq_queue_put(data, n))
+        {
+            break;
+        }
+        song_ram_pos += n;
+        if (i < n)
+        {
+            song_ram_play = 0;
+        }
+    }
+    if (song_ram_play)
+    {
+        seq_queue_wait(TASK_SONG_RAM, sizeof(data));
+    }
+}
+
+// Vyber nastroja pre nove tony, hrajuce tony doznia povodnym nastrojom
+void instrument_select(unsigned char index)
+{
+    instrument = index;
+    lcd_print_label(LCD_LINE_STATUS, "Zvuk: ", instruments[index].name);
+}
+
+// Cislo polozky 1 az 255 v argumente prikazu, 0 ak argument nie je cislo
+unsigned char arg_number(const char *arg)
+{
+    unsigned int n = 0;
+
+    do
+    {
+        if ((*arg < '0') || (*arg > '9') || (n > 25))
+        {
+            return 0;
+        }
+        n = n * 10 + (*arg - '0');
+    } while (*++arg);
+
+    return (n > 255) ? 0 : n;
+}
+
+// Porovnanie nazvu s argumentom prikazu bez ohladu na velkost pismen
+unsigned char name_equal(const char *name, const char *arg)
+{
+    for (; *name && ((*name | 0x20) == (*arg | 0x20)); name++, arg++);
+    return (*name == 0) && (*arg == 0);
+}
+
+/**
+ * Prikaz INST: bez argumentu vypise nastroje, inak vyberie nastroj podla cisla (1 az INSTRUMENTS)
+ * alebo nazvu (bez ohladu na velkost pismen).
+ */
+void cmd_inst(char *args)
+{
+    unsigned char i;
+
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    if (*args == 0)
+    {
+        term_send_str("Nastroje:");
+        for (i = 0; i < INSTRUMENTS; i++)
+        {
+            term_send_str((i == instrument) ? " *" : " ");
+            term_send_num(i + 1);
+            term_send_str(" ");
+            term_send_str(instruments[i].name);
+        }
+        term_send_crlf();
+        return;
+    }
+
+    i = arg_number(args);
+    if ((i >= 1) && (i <= INSTRUMENTS))
+    {
+        instrument_select(i - 1);
+        return;
+    }
+    for (i = 0; i < INSTRUMENTS; i++)
+    {
+        if (name_equal(instruments[i].name, args))
+        {
+            instrument_select(i);
+            return;
+        }
+    }
+    term_send_str("Neznamy nastroj, zoznam vypise prikaz INST");
+    term_send_crlf();
+}
+
+/**
+ * Prikaz SONG: bez argumentu vypise skladby, inak prehra skladbu podla cisla (1 az SONGS)
+ * alebo nazvu (bez ohladu na velkost pismen).
+ */
+void cmd_song(char *args)
+{
+    unsigned char i;
+
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    if (*args == 0)
+    {
+        term_send_str("Skladby:");
+        for (i = 0; i < SONGS; i++)
+        {
+            term_send_str((i == song_current) ? " *" : " ");
+            term_send_num(i + 1);
+            term_send_str(" ");
+            term_send_str(songs[i].name);
+        }
+        term_send_crlf();
+        return;
+    }
+
+    i = arg_number(args);
+    if ((i >= 1) && (i <= SONGS))
+    {
+        song_play(i - 1);
+        return;
+    }
+    for (i = 0; i < SONGS; i++)
+    {
+        if (name_equal(songs[i].name, args))
+        {
+            song_play(i);
+            return;
+        }
+    }
+    term_send_str("Neznama skladba, zoznam vypise prikaz SONG");
+    term_send_crlf();
+}
+
+// Text melodie sa iba skopiruje, spracuje ho uloha TASK_MELODY
+void cmd_play(char *args)
+{
+    if ((mel_input_state != MEL_INPUT_NONE) || song_ram_play)
+    {
+        term_send_str("Predchadzajuca melodia sa este spracuva");
+        term_send_crlf();
+        return;
+    }
+    if (!mel_input_put(args))
+    {
+        term_send_str("Melodia je prilis dlha");
+        term_send_crlf();
+        return;
+    }
+
+    lcd_print(LCD_LINE_STATUS, "Hra melodia");
+    mel_input_state = MEL_INPUT_BEGIN;
+    task_signal(TASK_MELODY);
+}
+
+// Prikaz STREAM: dalsie riadky terminalu su pokracovanim melodie az po riadok END
+void cmd_stream(char *args)
+{
+    (void)args;
+    if ((mel_input_state != MEL_INPUT_NONE) || song_ram_play)
+    {
+        term_send_str("Predchadzajuca melodia sa este spracuva");
+        term_send_crlf();
+        return;
+    }
+
+    term_send_str("Posielajte riadky melodie (najviac ");
+    term_send_num(MEL_LINE_MAX - 1);
+    term_send_str(" znakov), koniec riadkom END, zrusenie riadkom STOP");
+    term_send_crlf();
+    lcd_print(LCD_LINE_STATUS, "Prijem melodie");
+    mel_stream = 1;
+    mel_input_state = MEL_INPUT_BEGIN;
+    task_signal(TASK_MELODY);
+}
+
+// Volne miesto v mel_input
+unsigned int mel_input_free(void)
+{
+    return (mel_in_tail - mel_in_head - 1) & MEL_INPUT_MASK;
+}
+
+// Pridanie riadku melodie do mel_input, riadok dlhsi nez MEL_LINE_MAX alebo bez miesta sa odmietne
+unsigned char mel_input_put(const char *text)
+{
+    unsigned int len;
+
+    for (len = 0; text[len]; len++)
+    {
+        if (len == MEL_LINE_MAX - 1)
+        {
+            return 0;
+        }
+    }
+    if (mel_input_free() < len + 1)
+    {
+        return 0;
+    }
+
+    while (*text)
+    {
+        mel_input[mel_in_head] = *text++;
+        mel_in_head = (mel_in_head + 1) & MEL_INPUT_MASK;
+    }
+    mel_input[mel_in_head] = MEL_LINE_END;
+    mel_in_head = (mel_in_head + 1) & MEL_INPUT_MASK;
+    return 1;
+}
+
+// Zrusenie spracovania melodie (STOP), zastaveny terminal sa znova spusti
+void mel_input_reset(void)
+{
+    mel_input_state = MEL_INPUT_NONE;
+    mel_stream = 0;
+    mel_in_tail = mel_in_head;
+    mel_flow(XON);
+}
+
+// Riadenie toku terminalu, XON alebo XOFF sa posle iba pri zmene stavu
+void mel_flow(char c)
+{
+    char text[2];
+
+    if (mel_xoff == (c == XOFF))
+    {
+        return;
+    }
+    mel_xoff = (c == XOFF);
+    text[0] = c;
+    text[1] = 0;
+    term_send_str(text);
+}
+
+// Riadok terminalu v rezime STREAM
+void mel_stream_line(char *UserCommand, char *ComparedCommand)
+{
+    if (name_equal("END", UserCommand))
+    {
+        mel_stream = 0; // melodia skonci po spracovani buffra
+        task_signal(TASK_MELODY);
+        return;
+    }
+    if (name_equal("STOP", UserCommand))
+    {
+        cmd_stop(ComparedCommand + 4);
+        return;
+    }
+
+    if (!mel_input_put(ComparedCommand))
+    {
+        term_send_str("Riadok melodie sa nezmestil do buffra (dlhy riadok alebo terminal ignoroval XOFF)");
+        term_send_crlf();
+    }
+    if (mel_input_free() < MEL_XOFF_FREE)
+    {
+        mel_flow(XOFF);
+    }
+    task_signal(TASK_MELODY);
+}
+
+#ifdef STATS
+// Vypis jedneho merania casu: min/priemer/max v tikoch ACLK
+void stats_print(char *name, stats_time_t *t)
+{
+    term_send_str(name);
+    term_send_str(": min ");
+    term_send_num(t->count ? t->min : 0);
+    term_send_str(", priemer ");
+    term_send_num(t->count ? t->sum / t->count : 0);
+    term_send_str(", max ");
+    term_send_num(t->max);
+    term_send_str(" tikov ACLK, pocet ");
+    term_send_num(t->count);
+    term_send_crlf();
+}
+
+/**
+ * Oneskorenie cesty path, ktore neprekrocilo pct % z count merani: horna hranica intervalu histogramu,
+ * v ktorom percentil lezi, najviac vsak namerane maximum.
+ */
+unsigned int stats_lat_percentile(unsigned char path, unsigned char pct, unsigned int count)
+{
+    unsigned long need = ((unsigned long)count * pct + 99) / 100;
+    unsigned long sum = 0;
+    unsigned int high = 0;
+    unsigned char bin;
+
+    for (bin = 0; bin < STATS_LAT_BINS; bin++)
+    {
+        high += (1 << STATS_LAT_SHIFT) << (bin / STATS_LAT_SUB);
+        sum += stats_lat[path][bin];
+        if (sum >= need)
+        {
+            break;
+        }
+    }
+    return (high < stats_lat_max[path]) ? high : stats_lat_max[path];
+}
+
+/**
+ * Vypis statistik od posledneho prikazu STATS a ich vynulovanie.
+ * Cas merania sa urci zo sys_time, cas zapnuteho zvuku z poctu vygenerovanych blokov.
+ * CPU aktivne je cas mimo cpu_sleep vratane preruseni, v simulatore nema vyznam (kod firmware
+ * tam netrva ziaden simulovany cas), podiel LPM3 urcuje iba planovanie a plati aj tam.
+ * Odozva ulohy je cas od jej terminu (alebo signalu) po koniec jej behu.
+ */
+void cmd_stats(char *args)
+{
+    unsigned char i, bin;
+    unsigned int count;
+    unsigned long blocks = stats_render.count;
+    unsigned long elapsed = sys_time - stats_start;
+
+    (void)args;
+    term_send_str("Casy v tikoch ACLK (1 tik = 30,5 us), rozlisenie 1 tik");
+    term_send_crlf();
+    stats_print("Generovanie bloku", &stats_render);
+    term_send_str("Zataz CPU generovanim: ");
+    term_send_num(blocks ? stats_render.sum * 100 / (blocks * AUDIO_BLOCK_TICKS) : 0);
+    term_send_str(" %, nestihnute bloky: ");
+    term_send_num(stats_missed);
+    term_send_crlf();
+    stats_print("Krok sekvencera", &stats_seq);
+
+    for (i = 0; i < STATS_LAT_PATHS; i++)
+    {
+        for (bin = 0, count = 0; bin < STATS_LAT_BINS; bin++)
+        {
+            count += stats_lat[i][bin];
+        }
+        term_send_str("Oneskorenie ");
+        term_send_str(stats_lat_names[i]);
+        term_send_str(" -> DAC: p50 ");
+        term_send_num(TICKS_US(stats_lat_percentile(i, 50, count)));
+        term_send_str(", p99 ");
+        term_send_num(TICKS_US(stats_lat_percentile(i, 99, count)));
+        term_send_str(", max ");
+        term_send_num(TICKS_US(stats_lat_max[i]));
+        term_send_str(" us, pocet ");
+        term_send_num(count);
+        term_send_crlf();
+    }
+
+    for (i = 0; i < TASKS; i++)
+    {
+        term_send_str("Uloha ");
+        term_send_str(task_names[i]);
+        term_send_str(": odozva max ");
+        term_send_num(stats_task_resp[i]);
+        term_send_str(", beh max ");
+        term_send_num(stats_task_run[i]);
+        term_send_str(" tikov ACLK, pocet ");
+        term_send_num(stats_task_count[i]);
+        term_send_crlf();
+    }
+
+#ifdef AUDIO_SMCLK
+    term_send_str("SMCLK ");
+    term_send_num(audio_smclk);
+    term_send_str(" Hz, vzorkovanie ");
+    term_send_num(audio_smclk / audio_period);
+    term_send_str(" Hz");
+    term_send_crlf();
+#endif
+
+    term_send_str("Planovac: ");
+    term_send_num(elapsed ? stats_wakeups * TICKS_PER_SECOND / elapsed : 0);
+    term_send_str(" prebudeni/s, CPU aktivne ");
+    term_send_num(elapsed ? 100 - stats_sleep * 100 / elapsed : 0);
+    term_send_str(" % casu, LPM3 ");
+    term_send_num(elapsed ? stats_sleep_lpm3 * 100 / elapsed : 0);
+    term_send_str(" % casu, zvuk zapnuty ");
+    term_send_num(elapsed ? blocks * AUDIO_BLOCK_TICKS * 100 / elapsed : 0);
+    term_send_str(" % casu");
+    term_send_crlf();
+
+    stats_reset();
+}
+#endif
+
+// Dekodovanie prikazov uzivatela  v terminale
+unsigned char decode_user_cmd(char *UserCommand, char *ComparedCommand) 
+{
+    const cmd_t *cmd;
+    const char *name, *word;
+    unsigned char note, pos;
+    char text[LCD_CHARS + 1];
+
+    sleep_active = sys_time;
+
+    // v rezime STREAM su riadky pokracovanim melodie
+    if (mel_stream)
+    {
+        mel_stream_line(UserCommand, ComparedCommand);
+        return USER_COMMAND;
+    }
+
+    // ton sa dekoduje z povodneho textu, male 'b' je posuvka
+    if (note_decode(ComparedCommand, &note))
+    {
+        name = "Ton: ";
+        for (pos = 0; *name; pos++) text[pos] = *name++;
+        text[pos++] = UserCommand[0]; // nazov tonu velkym pismenom
+        for (word = ComparedCommand + 1; *word; pos++) text[pos] = *word++;
+        text[pos] = 0;
+#ifdef STATS
+        stats_lat_start(STATS_LAT_TERMINAL, TAR);
+#endif
+        notes_play(&note, 1, text);
+        return USER_COMMAND;
+    }
+
+    if ((UserCommand[0] == 0) || (UserCommand[1] == 0))
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    // jedno porovnanie s kandidatom z hashovacej tabulky, prikaz musi koncit koncom riadku alebo medzerou
+    cmd = &cmd_table[CMD_HASH(UserCommand[0], UserCommand[1], UserCommand[2])];
+    if (cmd->name == 0)
+    {
+        return (CMD_UNKNOWN);
+    }
+    for (name = cmd->name, word = UserCommand; *name; name++, word++)
+    {
+        if (*name != *word)
+        {
+            return (CMD_UNKNOWN);
+        }
+    }
+    if ((*word != 0) && (*word != ' '))
+    {
+        return (CMD_UNKNOWN);
+    }
+
+    // argumenty sa predavaju v povodnom tvare (bez prevodu na velke pismena)
+    cmd->handler(ComparedCommand + (word - UserCommand));
+    return USER_COMMAND;
+}
+
+/**
+ * Zaciatok novej melodie, column je stlpec prveho znaku melodie v prikazovom riadku.
+ * Prehravana skladba z flash pamate sa zastavi, melodia zadana pocas hrania predchadzajucej
+ * melodie sa zaradi za nu.
+ */
+void melody_begin(unsigned char column)
+{
+    unsigned int tick = MEL_TEMPO_TICK(mel_tempo);
+    unsigned char cmd[3];
+
+    if ((seq_state == SEQ_PLAYING) && (seq_src == SEQ_SRC_FLASH))
+    {
+        seq_stop();
+    }
+
+    mel_state = MEL_IDLE;
+    mel_column = column;
+    mel_len = 0; // sekvencer mohol medzitym hrat inu skladbu, dlzka tonu sa zapise znova
+
+    cmd[0] = SONG_CMD_TEMPO;
+    cmd[1] = tick & 0xFF;
+    cmd[2] = tick >> 8;
+    seq_queue_put(cmd, 3);
+}
+
+// Hlasenie chybneho tokenu so stlpcom jeho zaciatku, zvysok tokenu sa preskoci
+void mel_error(void)
+{
+    term_send_str("Chyba v melodii: neplatny token v stlpci ");
+    term_send_num(mel_token);
+    term_send_crlf();
+    mel_state = MEL_SKIP;
+}
+
+// Preklad dokonceneho tokenu do bajtkodu, pri chybnom tokene vrati 0
+unsigned char mel_emit(void)
+{
+    unsigned char cmd[3];
+    unsigned char len, note, div;
+    unsigned int tick;
+
+    if (mel_state == MEL_TEMPO)
+    {
+        if ((mel_num < MEL_TEMPO_MIN) || (mel_num > MEL_TEMPO_MAX))
+        {
+            return 0;
+        }
+        mel_tempo = mel_num;
+        tick = MEL_TEMPO_TICK(mel_tempo);
+        cmd[0] = SONG_CMD_TEMPO;
+        cmd[1] = tick & 0xFF;
+        cmd[2] = tick >> 8;
+        seq_queue_put(cmd, 3);
+        return 1;
+    }
+
+    div = mel_div;
+    if ((mel_state == MEL_DIV) || (mel_state == MEL_DOT && mel_num != 0))
+    {
+        // delitel musi byt mocnina 2 od 1 po 32
+        if ((mel_num == 0) || (mel_num > 32) || (mel_num & (mel_num - 1)))
+        {
+            return 0;
+        }
+        div = mel_num;
+    }
+    len = MEL_WHOLE / div;
+    if (mel_dot)
+    {
+        len += len / 2;
+    }
+
+    if (mel_note == MEL_REST)
+    {
+        mel_div = div;
+
+        // pauza dlhsia nez SONG_REST sa rozdeli
+        for (; len > MEL_WHOLE; len -= MEL_WHOLE)
+        {
+            cmd[0] = SONG_REST(MEL_WHOLE);
+            seq_queue_put(cmd, 1);
+        }
+        cmd[0] = SONG_REST(len);
+        seq_queue_put(cmd, 1);
+        return 1;
+    }
+
+    note = MIDI_NOTE(mel_note, mel_tok_octave) + mel_acc;
+    if ((note < NOTE_FIRST) || (note > NOTE_LAST))
+    {
+        return 0;
+    }
+    mel_octave = mel_tok_octave;
+    mel_div = div;
+
+    if (len != mel_len)
+    {
+        if (len <= 32)
+        {
+            cmd[0] = SONG_LEN(len);
+            seq_queue_put(cmd, 1);
+        }
+        else
+        {
+            cmd[0] = SONG_CMD_LEN;
+            cmd[1] = len;
+            seq_queue_put(cmd, 2);
+        }
+        mel_len = len;
+    }
+    seq_queue_put(&note, 1);
+    return 1;
+}
+
+/**
+ * Uloha TASK_MELODY - spracovanie textu melodie z prikazu PLAY. Znak sa spracuje iba ak sa do fronty
+ * sekvencera zmesti najdlhsi prikaz jedneho tokenu, zvysok textu sa spracuje po uvolneni miesta.
+ * Zapisy prekladaca do fronty (seq_queue_put) teda vzdy uspeju.
+ */
+void melody_task(void)
+{
+    char c;
+
+    if (mel_input_state == MEL_INPUT_BEGIN)
+    {
+        if (seq_queue_free() < MEL_CMD_MAX)
+        {
+            seq_queue_wait(TASK_MELODY, MEL_CMD_MAX);
+            return;
+        }
+        melody_begin(mel_stream ? 1 : 5); // text prikazu PLAY zacina za "PLAY "
+        mel_input_state = MEL_INPUT_FEED;
+    }
+
+    while ((mel_input_state == MEL_INPUT_FEED) && (seq_queue_free() >= MEL_CMD_MAX))
+    {
+        if (mel_in_tail == mel_in_head)
+        {
+            if (!mel_stream) // cely text je spracovany
+            {
+                melody_feed(0);
+                mel_input_state = MEL_INPUT_NONE;
+            }
+            break;
+        }
+        c = mel_input[mel_in_tail];
+        mel_in_tail = (mel_in_tail + 1) & MEL_INPUT_MASK;
+        melody_feed(c);
+    }
+    if ((mel_input_state == MEL_INPUT_FEED) && (seq_queue_free() < MEL_CMD_MAX))
+    {
+        seq_queue_wait(TASK_MELODY, MEL_CMD_MAX); // zvysok textu po uvolneni miesta sekvencerom
+    }
+
+    if (mel_input_free() >= MEL_XON_FREE)
+    {
+        mel_flow(XON);
+    }
+}
+
+/**
+ * Spracovanie jedneho znaku melodie, c = 0 ukoncuje text, MEL_LINE_END ukoncuje riadok.
+ * Hotovy token sa hned zaradi do fronty sekvencera, chybny sa nahlasi a preskoci.
+ */
+void melody_feed(char c)
+{
+    unsigned char end = (c == 0) || (c == MEL_LINE_END) || (c == ' ') || (c == '\t') || (c == ',');
+
+    if (mel_state == MEL_IDLE)
+    {
+        mel_token = mel_column;
+        if (end)
+        {
+            // medzery medzi tokenmi
+        }
+        else if ((c == 'T') || (c == 't'))
+        {
+            mel_num = 0;
+            mel_state = MEL_TEMPO;
+        }
+        else if ((c == 'R') || (c == 'r') || ((c >= 'A') && (c <= 'G')) || ((c >= 'a') && (c <= 'g')))
+        {
+            mel_note = ((c == 'R') || (c == 'r')) ? MEL_REST : mel_tones[(c | 0x20) - 'a'];
+            mel_acc = 0;
+            mel_tok_octave = mel_octave;
+            mel_dot = 0;
+            mel_num = 0;
+            mel_state = MEL_NAME;
+        }
+        else
+        {
+            mel_error();
+        }
+    }
+    else if (end)
+    {
+        if ((mel_state != MEL_SKIP) && ((mel_state == MEL_SLASH) || !mel_emit()))
+        {
+            mel_error();
+        }
+        mel_state = MEL_IDLE;
+    }
+    else
+    {
+        switch (mel_state)
+        {
+            case MEL_NAME:
+                if ((mel_note != MEL_REST) && ((c == '#') || (c == 'b')))
+                {
+                    mel_acc = (c == '#') ? 1 : -1;
+                    mel_state = MEL_ACC;
+                    break;
+                }
+                // FALLTHROUGH - pokracuje sa ako za posuvkou
+            case MEL_ACC:
+                if ((mel_note != MEL_REST) && (c >= '0') && (c <= '7'))
+                {
+                    mel_tok_octave = c - '0';
+                    mel_state = MEL_OCTAVE;
+                    break;
+                }
+                // FALLTHROUGH - pokracuje sa ako za oktavou
+            case MEL_OCTAVE:
+                if (c == '/')
+                {
+                    mel_state = MEL_SLASH;
+                }
+                else if (c == '.')
+                {
+                    mel_dot = 1;
+                    mel_state = MEL_DOT;
+                }
+                else
+                {
+                    mel_error();
+                }
+                break;
+
+            case MEL_SLASH:
+            case MEL_DIV:
+                if ((c >= '0') && (c <= '9') && (mel_num < 100))
+                {
+                    mel_num = mel_num * 10 + (c - '0');
+                    mel_state = MEL_DIV;
+                }
+                else if ((c == '.') && (mel_state == MEL_DIV))
+                {
+                    mel_dot = 1;
+                    mel_state = MEL_DOT;
+                }
+                else
+                {
+                    mel_error();
+                }
+                break;
+
+            case MEL_TEMPO:
+                if ((c >= '0') && (c <= '9') && (mel_num < 1000))
+                {
+                    mel_num = mel_num * 10 + (c - '0');
+                }
+                else
+                {
+                    mel_error();
+                }
+                break;
+
+            case MEL_DOT:
+                mel_error();
+                break;
+
+            default: // MEL_SKIP
+                break;
+        }
+    }
+
+    mel_column = (c == MEL_LINE_END) ? 1 : mel_column + 1; // stlpce riadkov STREAM sa cisluju od 1
+}
+
+
+// Dekodovanie vsetkych stlacenych klaves tonov, do pressed zapise indexy do key_notes a vrati ich pocet
+unsigned char tone_decoder(unsigned int keyboard_input, unsigned char *pressed)
+{
+    unsigned char i, count = 0;
+
+    for (i = 0; i < KEY_NOTES; i++)
+    {
+        if (keyboard_input & key_notes[i].key)
+        {
+            pressed[count++] = i;
+        }
+    }
+    return count;
+}
+
+
+
+// Spracovanie jednej udalosti klavesnice (novy stav vsetkych klaves) z FIFO v FPGA
+void key_event(unsigned int keyboard_input)
+{
+    unsigned char pressed[KEY_NOTES];
+    unsigned char count, i, pos;
+    unsigned int changed = keyboard_input ^ last_keyboard_input;
+    char text[LCD_CHARS + 1];
+    const char *label;
+
+    // ton znie presne tak dlho, ako je klavesa drzana
+    for (i = 0; i < KEY_NOTES; i++)
+    {
+        if (changed & key_notes[i].key)
+        {
+            if (keyboard_input & key_notes[i].key)
+            {
+                note_on(key_notes[i].note);
+#ifdef STATS
+                stats_lat_start(STATS_LAT_KEYBOARD, stats_key_stamp);
+#endif
+            }
+            else
+            {
+                note_off(key_notes[i].note);
+            }
+        }
+    }
+
+    count = tone_decoder(keyboard_input, pressed);
+
+    // displej sa prepise len ked pribudne stlaceny ton
+    if ((count != 0) && (changed & keyboard_input))
+    {
+        // jeden ton sa vypise aj s nazvom v nasej notacii, akord ako zoznam tonov (napr. "Akord: C4 E4 G4")
+        if (count == 1)
+        {
+            label = "Ton: ";
+            for (pos = 0; *label; pos++) text[pos] = *label++;
+            for (label = key_notes[pressed[0]].label; *label; pos++) text[pos] = *label++;
+        }
+        else
+        {
+            label = "Akord:";
+            for (pos = 0; *label; pos++) text[pos] = *label++;
+            for (i = 0; (i < count) && (pos + 3 <= LCD_CHARS); i++)
+            {
+                text[pos++] = ' ';
+                text[pos++] = key_notes[pressed[i]].label[0];
+                text[pos++] = key_notes[pressed[i]].label[1];
+            }
+        }
+        text[pos] = 0;
+        lcd_print(LCD_LINE_STATUS, text);
+    }
+
+    // klavesa B prepina nastroje pre dalsie tony
+    if ((keyboard_input & KEY_B) && !(last_keyboard_input & KEY_B))
+    {
+        instrument_select((instrument + 1) % INSTRUMENTS);
+    }
+
+    // klavesa D spusta (naposledy vybranu skladbu) a zastavuje skladbu, reaguje sa iba na stlacenie (nie drzanie) klavesy
+    if ((keyboard_input & KEY_D) && !(last_keyboard_input & KEY_D))
+    { 
+        if (seq_state == SEQ_PLAYING)
+        {
+            lcd_print(LCD_LINE_STATUS, "Stop skladby");
+            seq_feed_stop();
+            seq_stop();
+        }
+        else
+        {
+            song_play(song_current);
+        }
+    }
+
+    last_keyboard_input = keyboard_input;
+}
+
+/**
+ * Uloha TASK_KEYBOARD - vyprazdnenie FIFO udalosti klavesnice v FPGA. Spusta sa iba na signal
+ * od prerusenia (neprazdne FIFO), bez stlacania klaves teda neprebieha ziadna komunikacia.
+ */
+void keyboard_idle(void)
+{
+    // linka IRQ drzi log. 1, kym je vo FIFO udalost (nova udalost pocas citania nevyvola hranu)
+    while (P1IN & KEY_IRQ_PIN)
+    {
+        sleep_active = sys_time; // klavesa otvori okno LPM0, terminal znova prijima
+        key_event(FPGA_SPI_RW_A8_D16(SPI_FPGA_ENABLE_READ, KEY_FIFO_ADDR, 0));
+    }
+}
+
+// Prerusenie od linky IRQ z FPGA - vo FIFO klavesnice je udalost, SPI sa obsluzi v ulohe TASK_KEYBOARD
+interrupt (PORT1_VECTOR) Key_IRQ (void)
+{
+    P1IFG &= ~KEY_IRQ_PIN;
+    task_signal(TASK_KEYBOARD);
+    _BIC_SR_IRQ(LPM3_bits);
+#ifdef STATS
+    stats_key_stamp = TAR;
+#endif
+}
@@ -0,0 +1,13 @@
+/**
+ * @file songs.h
+ * Skladby v bajtkode sekvencera, prikaz terminalu SONG ich vypise a prehra.
+ * Vygenerovane programom sim/midi2song.c, subor needitovat rucne.
+ */
+
+#ifndef _SONGS_H_
+#define _SONGS_H_
+
+// polozky tabulky skladieb v mcu/main.c (nazov, bajtkod)
+#define SONG_TABLE
+
+#endif
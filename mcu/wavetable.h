@@ -0,0 +1,58 @@
+/**
+ * @file wavetable.h
+ * Tabulky vzoriek nastrojov, jedna perioda po 32 vzorkach pre kazdu oktavu 0 az 7.
+ * Vygenerovane programom sim/wavegen.c, subor needitovat rucne.
+ */
+
+#ifndef _WAVETABLE_H_
+#define _WAVETABLE_H_
+
+// klarinet: prevazuju neparne harmonicke
+const unsigned char wave_clarinet[8][32] = {
+    {128,251,255,239,221,211,202,202,198,200,202,211,219,236,246,238,128, 17,  9, 19, 36, 44, 53, 55, 57, 53, 53, 44, 34, 16,  0,  4}, // oktava 0
+    {128,251,255,239,221,211,202,202,198,200,202,211,219,236,246,238,128, 17,  9, 19, 36, 44, 53, 55, 57, 53, 53, 44, 34, 16,  0,  4}, // oktava 1
+    {128,251,255,239,221,211,202,202,198,200,202,211,219,236,246,238,128, 17,  9, 19, 36, 44, 53, 55, 57, 53, 53, 44, 34, 16,  0,  4}, // oktava 2
+    {128,251,255,239,221,211,202,202,198,200,202,211,219,236,246,238,128, 17,  9, 19, 36, 44, 53, 55, 57, 53, 53, 44, 34, 16,  0,  4}, // oktava 3
+    {128,223,255,231,204,201,203,193,186,193,201,200,204,228,245,213,128, 42, 10, 27, 51, 55, 54, 62, 69, 62, 52, 54, 51, 24,  0, 32}, // oktava 4
+    {128,187,232,255,254,234,208,186,178,187,209,233,249,248,224,182,128, 73, 31,  7,  6, 22, 46, 68, 77, 69, 47, 21,  1,  0, 23, 68}, // oktava 5
+    {128,153,178,201,220,236,247,254,255,252,243,231,215,196,174,151,128,104, 81, 59, 40, 24, 12,  3,  0,  1,  8, 19, 35, 54, 77,102}, // oktava 6
+    {128,152,176,198,218,234,245,253,255,253,245,234,218,198,176,152,128,103, 79, 57, 37, 21, 10,  2,  0,  2, 10, 21, 37, 57, 79,103} // oktava 7
+};
+
+// flauta: takmer sinus so slabymi nizkymi harmonickymi
+const unsigned char wave_flute[8][32] = {
+    {128,172,209,235,250,255,254,250,244,235,223,209,195,179,163,145,128,110, 92, 76, 60, 46, 32, 20, 11,  5,  1,  0,  5, 20, 46, 83}, // oktava 0
+    {128,172,209,235,250,255,254,250,244,235,223,209,195,179,163,145,128,110, 92, 76, 60, 46, 32, 20, 11,  5,  1,  0,  5, 20, 46, 83}, // oktava 1
+    {128,172,209,235,250,255,254,250,244,235,223,209,195,179,163,145,128,110, 92, 76, 60, 46, 32, 20, 11,  5,  1,  0,  5, 20, 46, 83}, // oktava 2
+    {128,172,209,235,250,255,254,250,244,235,223,209,195,179,163,145,128,110, 92, 76, 60, 46, 32, 20, 11,  5,  1,  0,  5, 20, 46, 83}, // oktava 3
+    {128,172,209,235,250,255,254,250,244,235,223,209,195,179,163,145,128,110, 92, 76, 60, 46, 32, 20, 11,  5,  1,  0,  5, 20, 46, 83}, // oktava 4
+    {128,170,207,234,249,255,254,249,241,233,223,210,195,178,161,144,128,111, 94, 77, 60, 45, 32, 22, 14,  6,  1,  0,  6, 21, 48, 85}, // oktava 5
+    {128,160,191,217,237,250,255,253,246,233,218,202,185,169,154,141,128,114,101, 86, 70, 53, 37, 22,  9,  2,  0,  5, 18, 38, 64, 95}, // oktava 6
+    {128,152,176,198,218,234,245,253,255,253,245,234,218,198,176,152,128,103, 79, 57, 37, 21, 10,  2,  0,  2, 10, 21, 37, 57, 79,103} // oktava 7
+};
+
+// organ: harmonicke 1, 2, 3, 4 a 8
+const unsigned char wave_organ[8][32] = {
+    {128,208,246,253,255,240,199,169,176,190,179,161,159,154,130,114,127,141,125,101, 96, 94, 76, 65, 79, 86, 56, 15,  0,  2,  9, 47}, // oktava 0
+    {128,208,246,253,255,240,199,169,176,190,179,161,159,154,130,114,127,141,125,101, 96, 94, 76, 65, 79, 86, 56, 15,  0,  2,  9, 47}, // oktava 1
+    {128,208,246,253,255,240,199,169,176,190,179,161,159,154,130,114,127,141,125,101, 96, 94, 76, 65, 79, 86, 56, 15,  0,  2,  9, 47}, // oktava 2
+    {128,208,246,253,255,240,199,169,176,190,179,161,159,154,130,114,127,141,125,101, 96, 94, 76, 65, 79, 86, 56, 15,  0,  2,  9, 47}, // oktava 3
+    {128,208,246,253,255,240,199,169,176,190,179,161,159,154,130,114,127,141,125,101, 96, 94, 76, 65, 79, 86, 56, 15,  0,  2,  9, 47}, // oktava 4
+    {128,191,237,255,246,221,194,177,172,174,176,170,157,141,130,126,128,129,125,114, 98, 85, 79, 81, 83, 78, 61, 34,  9,  0, 18, 64}, // oktava 5
+    {128,167,202,230,248,255,252,239,220,197,173,153,137,128,124,124,128,131,131,127,118,102, 82, 58, 35, 16,  3,  0,  7, 25, 53, 88}, // oktava 6
+    {128,152,176,198,218,234,245,253,255,253,245,234,218,198,176,152,128,103, 79, 57, 37, 21, 10,  2,  0,  2, 10, 21, 37, 57, 79,103} // oktava 7
+};
+
+// obdlznik: neparne harmonicke s amplitudou 1/k
+const unsigned char wave_square[8][32] = {
+    {128,255,225,243,230,241,231,240,231,240,231,241,230,243,225,255,128,  0, 30, 12, 25, 14, 24, 15, 24, 15, 24, 14, 25, 12, 30,  0}, // oktava 0
+    {128,255,225,243,230,241,231,240,231,240,231,241,230,243,225,255,128,  0, 30, 12, 25, 14, 24, 15, 24, 15, 24, 14, 25, 12, 30,  0}, // oktava 1
+    {128,255,225,243,230,241,231,240,231,240,231,241,230,243,225,255,128,  0, 30, 12, 25, 14, 24, 15, 24, 15, 24, 14, 25, 12, 30,  0}, // oktava 2
+    {128,255,225,243,230,241,231,240,231,240,231,241,230,243,225,255,128,  0, 30, 12, 25, 14, 24, 15, 24, 15, 24, 14, 25, 12, 30,  0}, // oktava 3
+    {128,222,255,238,224,234,244,235,227,235,244,234,224,238,255,222,128, 33,  0, 17, 31, 21, 11, 20, 28, 20, 11, 21, 31, 17,  0, 33}, // oktava 4
+    {128,179,221,247,255,249,235,223,218,223,235,249,255,247,221,179,128, 76, 34,  8,  0,  6, 20, 32, 37, 32, 20,  6,  0,  8, 34, 76}, // oktava 5
+    {128,152,176,198,218,234,245,253,255,253,245,234,218,198,176,152,128,103, 79, 57, 37, 21, 10,  2,  0,  2, 10, 21, 37, 57, 79,103}, // oktava 6
+    {128,152,176,198,218,234,245,253,255,253,245,234,218,198,176,152,128,103, 79, 57, 37, 21, 10,  2,  0,  2, 10, 21, 37, 57, 79,103} // oktava 7
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*******************************************************************************
+   fitkitlib.h: nahrada kniznice FITkit a registrov MSP430 pre simulaciu na PC
+
+   Deklaruje iba to, co pouziva mcu/main.c. Registre periferii su obycajne
+   premenne, ktore cita a meni simulator (sim/sim.c), obsluhy preruseni su
+   obycajne funkcie volane simulatorom.
+*******************************************************************************/
+
+#ifndef _SIM_FITKITLIB_H_
+#define _SIM_FITKITLIB_H_
+
+#include <stdint.h>
+
+// obsluha prerusenia je obycajna funkcia, vektor urcuje simulator
+#define interrupt(vector) void
+
+// 16-bitove registre periferii
+extern volatile unsigned short TACTL, TAR, TAIV, CCTL1, CCR1, CCTL2, CCR2;
+extern volatile unsigned short TBCTL, TBR, TBCCR0, TBCCTL1, TBCCR1, TBCCR2;
+extern volatile unsigned short DMACTL0, DMA0CTL, DMA0SZ;
+extern volatile uintptr_t DMA0SA, DMA0DA; // adresy DMA maju sirku ukazovatela (na MSP430 16 bitov)
+extern volatile unsigned short ADC12CTL0, DAC12_0CTL, DAC12_0DAT;
+extern volatile unsigned char P1IN, P1DIR, P1IES, P1IFG, P1IE;
+extern volatile unsigned char P4SEL, P4DIR;
+extern volatile unsigned char BCSCTL1, BCSCTL2, DCOCTL;
+
+#define BIT0 0x01
+#define BIT1 0x02
+#define BIT2 0x04
+#define BIT3 0x08
+#define BIT4 0x10
+#define BIT5 0x20
+#define BIT6 0x40
+#define BIT7 0x80
+
+// casovac A a B
+#define CCIE 0x0010
+#define CCIFG 0x0001
+#define CAP 0x0100
+#define SCS 0x0800
+#define CCIS_1 0x1000
+#define CM_1 0x4000
+#define TASSEL_1 0x0100
+#define TASSEL_2 0x0200
+#define TBSSEL_1 0x0100
+#define TBSSEL_2 0x0200
+#define MC_1 0x0010
+#define MC_2 0x0020
+#define TACLR 0x0004
+#define TBCLR 0x0004
+#define OUTMOD_7 0x00E0
+#define CLLD_1 0x0200
+
+// zdroje hodin
+#define SELS 0x08
+#define SELM_2 0x80
+
+// DMA
+#define DMA0TSEL_2 0x0002
+#define DMADT_0 0x0000
+#define DMASRCINCR_3 0x0300
+#define DMADSTINCR_0 0x0000
+#define DMAIFG 0x0008
+#define DMAIE 0x0004
+#define DMAEN 0x0010
+
+// stavovy register: globalne povolenie preruseni a rezimy nizkej spotreby
+#define GIE 0x0008
+#define CPUOFF 0x0010
+#define SCG0 0x0040
+#define SCG1 0x0080
+#define LPM0_bits (CPUOFF)
+#define LPM3_bits (SCG1 + SCG0 + CPUOFF)
+
+// simulator ISR nevnara, eint() a dint() nemaju ucinok
+void eint(void);
+void dint(void);
+
+// uspanie CPU posuva simulovany cas, kym niektora obsluha prerusenia nezavola _BIC_SR_IRQ
+void _BIS_SR(unsigned int bits);
+void _BIC_SR_IRQ(unsigned int bits);
+
+// jedna instrukcia, v simulatore trva jeden tik ACLK (aktivne cakanie firmware posuva simulovany cas)
+void nop(void);
+
+// kniznica FITkit
+#define CMD_UNKNOWN 0
+#define USER_COMMAND 1
+
+#define SPI_FPGA_ENABLE_WRITE 0x01
+#define SPI_FPGA_ENABLE_READ 0x02
+
+void initialize_hardware(void);
+void WDG_stop(void);
+void terminal_idle(void);
+void delay_ms(unsigned int ms);
+void term_send_str(char *s);
+void term_send_str_crlf(char *s);
+void term_send_crlf(void);
+void term_send_num(long n);
+int strcmp2(char *s1, char *s2);
+int strcmp4(char *s1, char *s2);
+unsigned int FPGA_SPI_RW_A8_D16(unsigned char mode, unsigned char addr, unsigned int data);
+void FPGA_SPI_RW_AN_DN(unsigned char mode, unsigned long addr, unsigned char *data, unsigned char addrw, unsigned int dataw);
+
+#endif
@@ -0,0 +1,577 @@
+/*******************************************************************************
+   midi2song.c: prekladac MIDI suborov do skladieb pre mcu/songs.h
+
+   Nacita Standard MIDI File (format 0 alebo 1), zluci vybrane stopy do jedneho
+   hlasu a zarovna casy tonov na mriezku (-g krokov na stvrtovu notu), krok
+   mriezky je tik skladby sekvencera. Z naraz znejucich tonov sa hra najvyssi,
+   bicie (kanal 10) sa vynechavaju a tony mimo rozsahu firmware (C0 az B7) sa
+   posunu o oktavy. Vystupom je bajtkod sekvencera (FORMAT SKLADBY v mcu/main.c):
+   dlzka tonu sa zapise iba pri zmene a pauzy su ulozene dlzkou, ton teda
+   zvycajne zabera jeden bajt. Zmena tempa v MIDI sa zapise ako prikaz tempa
+   na zaciatku najblizsieho tonu alebo pauzy.
+
+   Preklad a vygenerovanie (z korenoveho adresara projektu):
+     gcc -O2 sim/midi2song.c -o sim/midi2song
+     sim/midi2song [-t stopy] [-g mriezka] subor.mid ... > mcu/songs.h
+   Volby plati pre vsetky nasledujuce subory, napr.
+     sim/midi2song -t 2 prva.mid -t 1,3 -g 8 druha.mid > mcu/songs.h
+   -t 1,3   zlucia sa iba stopy 1 a 3 (cislovane od 1, 0 = vsetky stopy)
+   -g 4     mriezka v krokoch na stvrtovu notu (predvolene 4, teda sestnastiny)
+   -l       namiesto hlavicky vypise prikazy terminalu, ktore nahraju jednu skladbu
+            do pamate skladieb v FPGA (RAM NEW, RAM <hex>, ...), napr.
+              sim/midi2song -l skladba.mid > skladba.txt
+              sim/imp_sim skladba.wav @skladba.txt "RAM PLAY"
+   Bez suborov sa vygeneruje prazdna tabulka skladieb.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define ACLK_HZ 32768
+#define NOTE_FIRST 12           // C0, musi suhlasit s mcu/main.c
+#define NOTE_LAST 107           // B7
+#define DEFAULT_TEMPO 500000    // us na stvrtovu notu (120 BPM)
+#define DEFAULT_GRID 4
+#define MAX_TRACKS 64
+#define RAM_LINE 24             // bajtov v jednom prikaze RAM (SONG_RAM_LINE v mcu/main.c)
+#define RAM_BYTES 2048          // velkost pamate skladieb v FPGA
+#define NAME_LEN 16     // vratane predpony s, cisla pri rovnakom nazve (3 znaky) a koncovej nuly
+#define SONG_PREFIX "song_data_" // predpona pola bajtkodu, nekoliduje s identifikatormi mcu/main.c (song_t)
+
+// bajtkod sekvencera (mcu/main.c)
+#define SONG_REST_MAX 64
+#define SONG_LEN_SHORT 32
+#define SONG_LEN_MAX 255
+#define SONG_CMD_TEMPO 0xE0
+#define SONG_CMD_LEN 0xE1
+#define SONG_END 0xFF
+
+typedef struct {
+    unsigned long start, end;   // v tikoch MIDI
+    unsigned char note;
+} note_t;
+
+typedef struct {
+    unsigned long time;         // v tikoch MIDI
+    unsigned long tempo;        // us na stvrtovu notu
+} tempo_t;
+
+typedef struct {
+    unsigned char *data;
+    unsigned long len, size;
+} buf_t;
+
+note_t *notes;
+unsigned long notes_count, notes_size;
+tempo_t *tempos;
+unsigned long tempos_count, tempos_size;
+
+void fail(const char *file, const char *msg)
+{
+    fprintf(stderr, "midi2song: %s: %s\n", file, msg);
+    exit(1);
+}
+
+void *grow(void *p, unsigned long *size, unsigned long count, size_t item)
+{
+    if (count < *size)
+    {
+        return p;
+    }
+    *size = *size ? *size * 2 : 256;
+    p = realloc(p, *size * item);
+    if (p == NULL)
+    {
+        fail("midi2song", "nedostatok pamate");
+    }
+    return p;
+}
+
+void put(buf_t *b, unsigned char byte)
+{
+    b->data = grow(b->data, &b->size, b->len, 1);
+    b->data[b->len++] = byte;
+}
+
+unsigned long be(const unsigned char *p, int n)
+{
+    unsigned long v = 0;
+
+    while (n--)
+    {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+// Cislo s premenlivou dlzkou (7 bitov na bajt), pos sa posunie za cislo
+unsigned long vlq(const unsigned char *p, unsigned long *pos, unsigned long end)
+{
+    unsigned long v = 0;
+
+    while (*pos < end)
+    {
+        v = (v << 7) | (p[*pos] & 0x7F);
+        if (!(p[(*pos)++] & 0x80))
+        {
+            break;
+        }
+    }
+    return v;
+}
+
+// Ukonci vsetky otvorene tony s danym kanalom a vyskou
+void note_end(unsigned long *open, unsigned char ch, unsigned char note, unsigned long time)
+{
+    unsigned long i = open[ch * 128 + note];
+
+    if (i != 0)
+    {
+        notes[i - 1].end = time;
+        open[ch * 128 + note] = 0;
+    }
+}
+
+// Nacita tony jednej stopy, tempa sa citaju zo vsetkych stop
+void read_track(const char *file, const unsigned char *p, unsigned long len, int use_notes)
+{
+    static unsigned long open[16 * 128]; // index+1 otvoreneho tonu pre kanal a vysku
+    unsigned long pos = 0, time = 0, n;
+    unsigned char status = 0, type, ch, note;
+
+    memset(open, 0, sizeof(open));
+    while (pos < len)
+    {
+        time += vlq(p, &pos, len);
+        if (pos >= len)
+        {
+            break;
+        }
+        if (p[pos] & 0x80)
+        {
+            status = p[pos++];
+        }
+        else if (status == 0)
+        {
+            fail(file, "chybny beh stavoveho bajtu");
+        }
+
+        if (status == 0xFF) // meta udalost
+        {
+            type = p[pos++];
+            n = vlq(p, &pos, len);
+            if ((type == 0x51) && (n == 3) && (pos + 3 <= len))
+            {
+                tempos = grow(tempos, &tempos_size, tempos_count, sizeof(tempo_t));
+                tempos[tempos_count].time = time;
+                tempos[tempos_count++].tempo = be(p + pos, 3);
+            }
+            pos += n;
+            status = 0; // meta udalosti a SysEx rusia beh stavoveho bajtu
+            continue;
+        }
+        if ((status == 0xF0) || (status == 0xF7)) // SysEx
+        {
+            n = vlq(p, &pos, len);
+            pos += n;
+            status = 0;
+            continue;
+        }
+
+        type = status & 0xF0;
+        ch = status & 0x0F;
+        if ((type == 0xC0) || (type == 0xD0)) // jeden datovy bajt
+        {
+            pos++;
+            continue;
+        }
+        if (pos + 2 > len)
+        {
+            break;
+        }
+        note = p[pos] & 0x7F;
+        if (use_notes && (ch != 9) && ((type == 0x90) || (type == 0x80)))
+        {
+            note_end(open, ch, note, time);
+            if ((type == 0x90) && (p[pos + 1] != 0)) // nulova dynamika znamena koniec tonu
+            {
+                notes = grow(notes, &notes_size, notes_count, sizeof(note_t));
+                notes[notes_count].start = time;
+                notes[notes_count].end = time;
+                notes[notes_count++].note = note;
+                open[ch * 128 + note] = notes_count;
+            }
+        }
+        pos += 2;
+    }
+    // neukoncene tony znie do konca stopy
+    for (n = 0; n < 16 * 128; n++)
+    {
+        if (open[n])
+        {
+            notes[open[n] - 1].end = time;
+        }
+    }
+}
+
+// Nacita subor, use[t] urcuje pouzite stopy (use[0] = vsetky), vrati pocet tikov MIDI na stvrtovu notu
+unsigned int read_midi(const char *file, const unsigned char *use)
+{
+    FILE *f = fopen(file, "rb");
+    unsigned char *p;
+    unsigned long len, pos, n;
+    unsigned int division, tracks, track = 0;
+
+    if (f == NULL)
+    {
+        fail(file, "subor sa neda otvorit");
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    p = malloc(len ? len : 1);
+    if ((p == NULL) || (fread(p, 1, len, f) != len))
+    {
+        fail(file, "chyba citania");
+    }
+    fclose(f);
+
+    if ((len < 14) || memcmp(p, "MThd", 4) || (be(p + 4, 4) < 6))
+    {
+        fail(file, "nie je Standard MIDI File");
+    }
+    if (be(p + 8, 2) > 1)
+    {
+        fail(file, "podporovany je iba format 0 a 1");
+    }
+    tracks = be(p + 10, 2);
+    division = be(p + 12, 2);
+    if ((division & 0x8000) || (division == 0))
+    {
+        fail(file, "casovanie SMPTE nie je podporovane");
+    }
+
+    pos = 8 + be(p + 4, 4);
+    while ((pos + 8 <= len) && (track < tracks))
+    {
+        n = be(p + pos + 4, 4);
+        if (pos + 8 + n > len)
+        {
+            fail(file, "stopa presahuje koniec suboru");
+        }
+        if (!memcmp(p + pos, "MTrk", 4))
+        {
+            track++;
+            read_track(file, p + pos + 8, n, use[0] || ((track < MAX_TRACKS) && use[track]));
+        }
+        pos += 8 + n;
+    }
+    free(p);
+    return division;
+}
+
+int cmp_tempo(const void *a, const void *b)
+{
+    const tempo_t *x = a, *y = b;
+
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+// Tik skladby v tikoch ACLK pre tempo (us na stvrtovu notu) a mriezku
+unsigned int song_tick(unsigned long tempo, unsigned int grid)
+{
+    unsigned long tick = (tempo * ACLK_HZ / grid + 500000) / 1000000;
+
+    if (tick == 0)
+    {
+        tick = 1;
+    }
+    return (tick > 0xFFFF) ? 0xFFFF : tick;
+}
+
+void emit_rest(buf_t *b, unsigned long steps)
+{
+    while (steps)
+    {
+        unsigned long t = (steps > SONG_REST_MAX) ? SONG_REST_MAX : steps;
+
+        put(b, 0x80 | (t - 1));
+        steps -= t;
+    }
+}
+
+/**
+ * Prelozi nacitane tony do bajtkodu: casy sa zaokruhlia na mriezku, v kazdom kroku
+ * znie najvyssi ton a novy ton zacina pri zmene vysky alebo pri opakovanom uhodeni.
+ */
+void compile(buf_t *b, unsigned int division, unsigned int grid, unsigned long *notes_out)
+{
+    unsigned long steps = 0, s, i, run, len, cur_len = 0, t = 0, cur_tempo = 0;
+    short *pitch;
+    unsigned char *onset, note;
+
+    for (i = 0; i < notes_count; i++)
+    {
+        notes[i].start = (notes[i].start * grid + division / 2) / division;
+        notes[i].end = (notes[i].end * grid + division / 2) / division;
+        if (notes[i].end <= notes[i].start)
+        {
+            notes[i].end = notes[i].start + 1;
+        }
+        if (notes[i].end > steps)
+        {
+            steps = notes[i].end;
+        }
+    }
+
+    pitch = malloc((steps + 1) * sizeof(short));
+    onset = calloc(steps + 1, 1);
+    if ((pitch == NULL) || (onset == NULL))
+    {
+        fail("midi2song", "nedostatok pamate");
+    }
+    for (s = 0; s <= steps; s++)
+    {
+        pitch[s] = -1;
+    }
+    for (i = 0; i < notes_count; i++)
+    {
+        note = notes[i].note;
+        while (note < NOTE_FIRST) note += 12;
+        while (note > NOTE_LAST) note -= 12;
+        notes[i].note = note;
+        for (s = notes[i].start; s < notes[i].end; s++)
+        {
+            if (note > pitch[s])
+            {
+                pitch[s] = note;
+            }
+        }
+    }
+    // opakovane uhodenie sa zohladni iba pre ton, ktory v danom kroku znie
+    for (i = 0; i < notes_count; i++)
+    {
+        if (notes[i].note == pitch[notes[i].start])
+        {
+            onset[notes[i].start] = 1;
+        }
+    }
+
+    qsort(tempos, tempos_count, sizeof(tempo_t), cmp_tempo);
+    *notes_out = 0;
+    for (s = 0; s < steps; s += run)
+    {
+        // tempo platne v kroku s
+        unsigned long tempo = DEFAULT_TEMPO;
+        for (; (t < tempos_count) && ((tempos[t].time * grid + division / 2) / division <= s); t++);
+        if (t)
+        {
+            tempo = tempos[t - 1].tempo;
+        }
+        if (tempo != cur_tempo)
+        {
+            unsigned int tick = song_tick(tempo, grid);
+
+            put(b, SONG_CMD_TEMPO);
+            put(b, tick & 0xFF);
+            put(b, tick >> 8);
+            cur_tempo = tempo;
+        }
+
+        for (run = 1; (s + run < steps) && (pitch[s + run] == pitch[s]) &&
+             !((pitch[s] >= 0) && onset[s + run]); run++);
+
+        if (pitch[s] < 0)
+        {
+            emit_rest(b, run);
+            continue;
+        }
+
+        len = (run > SONG_LEN_MAX) ? SONG_LEN_MAX : run;
+        if (len != cur_len)
+        {
+            if (len <= SONG_LEN_SHORT)
+            {
+                put(b, 0xC0 | (len - 1));
+            }
+            else
+            {
+                put(b, SONG_CMD_LEN);
+                put(b, len);
+            }
+            cur_len = len;
+        }
+        put(b, pitch[s]);
+        emit_rest(b, run - len);
+        (*notes_out)++;
+    }
+    put(b, SONG_END);
+
+    free(pitch);
+    free(onset);
+}
+
+/**
+ * Nazov skladby z nazvu suboru: bez cesty a pripony, iba male pismena a cislice, nezacina cislicou.
+ * Nazov je teda platnym koncom identifikatora v C a s predponou SONG_PREFIX nemoze byt klucovym slovom.
+ */
+void song_name(const char *file, char *name)
+{
+    const char *p = strrchr(file, '/');
+    int n = 0;
+
+    for (p = p ? p + 1 : file; *p && (*p != '.') && (n < NAME_LEN - 5); p++)
+    {
+        if (isalnum((unsigned char)*p))
+        {
+            name[n++] = tolower((unsigned char)*p);
+        }
+    }
+    if ((n == 0) || isdigit((unsigned char)name[0])) // identifikator v C nesmie zacinat cislicou
+    {
+        memmove(name + 1, name, n);
+        name[0] = 's';
+        n++;
+    }
+    name[n] = 0;
+}
+
+void parse_tracks(const char *arg, unsigned char *use)
+{
+    char *end;
+    long t;
+
+    memset(use, 0, MAX_TRACKS);
+    do
+    {
+        t = strtol(arg, &end, 10);
+        if ((end == arg) || (t < 0) || (t >= MAX_TRACKS))
+        {
+            fail(arg, "chybne cislo stopy");
+        }
+        use[t] = 1;
+        arg = end + 1;
+    } while (*end == ',');
+}
+
+// Prikazy terminalu pre nahranie skladby do FPGA, pocet bajtov sa doplni na parny bajtom SONG_END
+void print_ram(const char *file, const buf_t *b)
+{
+    unsigned long i;
+
+    if (b->len > RAM_BYTES)
+    {
+        fail(file, "skladba sa nezmesti do pamate skladieb v FPGA");
+    }
+    printf("RAM NEW");
+    for (i = 0; i < b->len + (b->len & 1); i++)
+    {
+        printf("%s%02X", (i % RAM_LINE) ? " " : "\nRAM ", (i < b->len) ? b->data[i] : SONG_END);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char use[MAX_TRACKS] = {1};
+    char names[argc][NAME_LEN];
+    unsigned int grid = DEFAULT_GRID, division;
+    unsigned long i, count, total = 0;
+    int a, songs = 0, ram = 0;
+    buf_t b;
+
+    for (a = 1; a < argc; a++)
+    {
+        ram |= !strcmp(argv[a], "-l");
+    }
+    if (!ram)
+    {
+        printf("/**\n");
+        printf(" * @file songs.h\n");
+        printf(" * Skladby v bajtkode sekvencera, prikaz terminalu SONG ich vypise a prehra.\n");
+        printf(" * Vygenerovane programom sim/midi2song.c, subor needitovat rucne.\n");
+        printf(" */\n\n");
+        printf("#ifndef _SONGS_H_\n#define _SONGS_H_\n");
+    }
+
+    for (a = 1; a < argc; a++)
+    {
+        if (!strcmp(argv[a], "-t") && (a + 1 < argc))
+        {
+            parse_tracks(argv[++a], use);
+            continue;
+        }
+        if (!strcmp(argv[a], "-g") && (a + 1 < argc))
+        {
+            grid = atoi(argv[++a]);
+            if ((grid == 0) || (grid > 96))
+            {
+                fail(argv[a], "chybna mriezka");
+            }
+            continue;
+        }
+        if (!strcmp(argv[a], "-l"))
+        {
+            continue;
+        }
+        if ((argv[a][0] == '-') || (ram && songs))
+        {
+            fprintf(stderr, "pouzitie: midi2song [-t stopy] [-g mriezka] subor.mid ... > songs.h\n");
+            fprintf(stderr, "          midi2song -l [-t stopy] [-g mriezka] subor.mid > prikazy.txt\n");
+            return 1;
+        }
+
+        notes_count = tempos_count = 0;
+        memset(&b, 0, sizeof(b));
+        division = read_midi(argv[a], use);
+        compile(&b, division, grid, &count);
+        fprintf(stderr, "%s: %lu tonov, %lu bajtov\n", argv[a], count, b.len);
+        total += b.len;
+        if (ram)
+        {
+            print_ram(argv[a], &b);
+            songs++;
+            free(b.data);
+            continue;
+        }
+
+        song_name(argv[a], names[songs]);
+        for (i = 0; i < (unsigned long)songs; i++) // rovnaky nazov dostane cislo
+        {
+            if (!strcmp(names[i], names[songs]))
+            {
+                sprintf(names[songs] + strlen(names[songs]), "%d", (songs + 1) % 1000);
+                i = -1;
+            }
+        }
+
+        printf("\n// %s: %lu tonov, %lu bajtov\n", argv[a], count, b.len);
+        printf("const unsigned char " SONG_PREFIX "%s[] = {", names[songs]);
+        for (i = 0; i < b.len; i++)
+        {
+            printf("%s0x%02X", (i % 12) ? ", " : (i ? ",\n    " : "\n    "), b.data[i]);
+        }
+        printf("\n};\n");
+        songs++;
+        free(b.data);
+    }
+
+    if (ram)
+    {
+        return 0;
+    }
+    printf("\n// polozky tabulky skladieb v mcu/main.c (nazov, bajtkod)\n");
+    printf("#define SONG_TABLE");
+    for (a = 0; a < songs; a++)
+    {
+        printf(" \\\n    {\"%s\", " SONG_PREFIX "%s},", names[a], names[a]);
+    }
+    printf("\n\n#endif\n");
+    if (songs > 1)
+    {
+        fprintf(stderr, "spolu %d skladieb, %lu bajtov\n", songs, total);
+    }
+    return 0;
+}
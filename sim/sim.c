@@ -0,0 +1,804 @@
+/*******************************************************************************
+   sim.c: simulacia FITkitu na PC
+
+   Firmware mcu/main.c sa preklada bez zmien proti nahradam kniznice FITkit
+   a registrov MSP430 v sim/include. Simuluje sa casovac A z ACLK (sekvencer
+   skladby v preruseni od CCR1) a casovac B s DMA kanalom 0, ktory presuva
+   vzorky do DAC12_0DAT. Kazda vzorka DA prevodnika sa zapise do WAV suboru.
+   Pri preklade firmware s -DAUDIO_PWM presuva DMA dlzky impulzov do TBCCR1
+   a do WAV suboru sa zapisuje stredna hodnota PWM na TB1 za kazdu periodu.
+   SMCLK bezi z XT2 (SIM_SMCLK_HZ), casovac A zo SMCLK zachytava ACLK do CCR2
+   (meranie SMCLK pri preklade firmware s -DAUDIO_SMCLK). Z FPGA sa simuluje
+   znakova pamat displeja, pamat skladieb (prikaz RAM) a FIFO klavesnice
+   s linkou IRQ (pouziva ho iba meranie oneskorenia).
+
+   Simulovany cas plynie iba vo volaniach terminal_idle(), delay_ms(), nop()
+   a pri uspani CPU (_BIS_SR) vo firmware, vysledok teda nezavisi od rychlosti
+   PC a skladba sa vygeneruje mnohonasobne rychlejsie nez v realnom case.
+   Firmware sa pre simulator neupravuje: kazde cakanie vo firmware (na priznak
+   casovaca s nop(), na prerusenie v cpu_sleep()) prechadza jednou z tychto
+   nahrad, cakanie bez nich by simulator zastavilo. Kod firmware netrva ziaden
+   simulovany cas, "CPU aktivne" v STATS je teda iba cas volani terminal_idle().
+   LPM0 a LPM3 sa nerozlisuju, prikazy terminalu sa dorucia aj v LPM3.
+
+   Preklad (z korenoveho adresara projektu):
+     gcc -O2 -Isim/include -Dmain=fw_main -c mcu/main.c -o sim/main.o
+     gcc -O2 -Isim/include sim/sim.c sim/main.o -o sim/imp_sim
+   Volby prekladu firmware (napr. -DAUDIO_SMCLK) sa pridaju do prveho prikazu.
+
+   Spustenie (prikazy terminalu sa vykonaju postupne, bez prikazu sa hra DEMO):
+     sim/imp_sim demo.wav
+     sim/imp_sim melodia.wav "PLAY T120 C4/4 D4/8 R/8 F#5/2."
+   Argument @subor posle terminalu riadky suboru, napr. dlhu melodiu za prikazom
+   STREAM. Terminal dodrzuje XON/XOFF od firmware, dalsi riadok po XOFF posle
+   az po XON:
+     sim/imp_sim dlha.wav STREAM @melodia.txt END
+
+   Meranie oneskorenia (volba -l pocet): simulator v nahodnom case zada ton
+   klavesnicou (udalost vo FIFO a IRQ z FPGA), riadkom terminalu "C4" a krokom
+   sekvencera (PLAY C4/16) a zmeria cas po prvu nenulovu vzorku DA prevodnika.
+   Kazda cesta sa zmeria pocet krat, polovica tonov sa zada tesne po dozneni
+   predchadzajuceho (zvuk este bezi) a polovica po vypnuti zvuku. Vysledky sa
+   rozdelia podla toho, ci zvuk pocas merania bezal, alebo sa musel zapnut
+   (vratane ustalenia reference). Sekvencer ma iba vysledky z ticha: ton
+   zacne az po spracovani riadku PLAY ulohou terminalu (perioda 10 ms),
+   firmware zatial zvuk po dvoch tichych blokoch vypne. Ton skladby pri
+   zapnutom zvuku meria iba firmware (STATS). Vypise p50, p99 a max v us; za meranim sa
+   vykonaju zadane prikazy, napr. STATS s oneskorenim namerany firmware:
+     sim/imp_sim -l 100 latencia.wav STATS
+   Ton z terminalu sa meria od prijatia riadku (firmware ho spracuje az
+   v ulohe terminalu), ton skladby od prerusenia CCR1, v ktorom zacal.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include <fitkitlib.h>
+#include <keyboard/keyboard.h>
+
+#define ACLK_HZ 32768
+#define SIM_SMCLK_HZ 7372800        // krystal XT2 FITkitu
+#define SIM_SMCLK_PER_ACLK (SIM_SMCLK_HZ / ACLK_HZ) // 225 tikov SMCLK za tik ACLK
+#define SIM_STEP 32                 // tikov ACLK simulovanych za jedno volanie terminal_idle
+#define SIM_TAIL (ACLK_HZ / 4)      // ticho na vystupe po skonceni skladby, po ktorom simulacia skonci
+#define SIM_MAX_TICKS (600 * ACLK_HZ) // najdlhsi simulovany cas
+#define SIM_CMD_LEN 128
+#define LCD_LINES 2
+#define LCD_CHARS 16
+#define SIM_LCD_FB_POS 0x40         // znakova pamat displeja v FPGA (fpga/lcd_fb.vhd)
+#define SIM_LCD_FB_DATA 0x41        // datovy register zabera okno 0x41 az 0x5F
+#define SIM_LCD_FB_END 0x5F
+#define SIM_SONG_RAM_PTR 0x20       // pamat skladieb v FPGA (fpga/song_ram.vhd)
+#define SIM_SONG_RAM_DATA 0x21      // datovy register zabera okno 0x21 az 0x3F
+#define SIM_SONG_RAM_END 0x3F
+#define SIM_SONG_RAM_WORDS 1024
+#define SIM_KEY_FIFO 0x02           // FIFO udalosti klavesnice v FPGA
+#define SIM_KEY_FIFO_SIZE 8
+#define SIM_KEY_IRQ_PIN 0x01        // linka IRQ z FPGA na P1.0
+
+// meranie oneskorenia
+#define BENCH_KEYBOARD 0
+#define BENCH_TERMINAL 1
+#define BENCH_SEQUENCER 2
+#define BENCH_PATHS 3
+#define BENCH_MAX 1000                // najviac merani jednej cesty
+#define BENCH_QUIET 64                // tikov ticha na vystupe pred zadanim tonu
+#define BENCH_WARM_SPREAD 64          // rozptyl casu zadania pri zapnutom zvuku (kym sa zvuk nevypne)
+#define BENCH_COLD_SPREAD (ACLK_HZ / 20) // rozptyl casu zadania z ticha (50 ms)
+#define BENCH_KEY_HOLD (ACLK_HZ / 20) // klavesa sa drzi 50 ms od zaznenia tonu
+#define BENCH_TIMEOUT ACLK_HZ         // najdlhsie cakanie na ton
+#define BENCH_IDLE 0                  // caka sa na ticho
+#define BENCH_ARMED 1                 // ton sa zada v case bench_at
+#define BENCH_WAIT 2                  // caka sa na prvu nenulovu vzorku
+
+// registre periferii
+volatile unsigned short TACTL, TAR, TAIV, CCTL1, CCR1, CCTL2, CCR2;
+volatile unsigned short TBCTL, TBR, TBCCR0, TBCCTL1, TBCCR1, TBCCR2;
+volatile unsigned short DMACTL0, DMA0CTL, DMA0SZ;
+volatile uintptr_t DMA0SA, DMA0DA;
+volatile unsigned short ADC12CTL0, DAC12_0CTL, DAC12_0DAT;
+volatile unsigned char P1IN, P1DIR, P1IES, P1IFG, P1IE;
+volatile unsigned char P4SEL, P4DIR;
+volatile unsigned char BCSCTL1, BCSCTL2, DCOCTL;
+
+// firmware (mcu/main.c)
+int fw_main(void);
+void fpga_initialized(void);
+void print_user_help(void);
+unsigned char decode_user_cmd(char *UserCommand, char *ComparedCommand);
+void Timer_A1(void);
+void Audio_DMA(void);
+void Key_IRQ(void);
+extern unsigned int audio_buf[];     // buffre vzoriek, jediny zdroj prenosov DMA
+extern volatile unsigned char seq_state; // 0 = SEQ_STOPPED
+extern volatile unsigned char audio_on;
+
+// stav simulacie
+unsigned int sim_ticks = 0;          // simulovany cas v tikoch ACLK
+unsigned int sim_silent = 0;         // dlzka ticha na vystupe v tikoch ACLK
+unsigned short sim_dma_n = 0;        // pocet prenosov DMA od povolenia kanala
+unsigned int *sim_dma_src;           // zdroj prenosov DMA
+unsigned int sim_period;             // perioda vzorkovania vystupu v tikoch hodin casovaca B
+unsigned int sim_tb_clock;           // tiky hodin casovaca B za tik ACLK
+unsigned int sim_phase = 0;          // tiky hodin casovaca B od poslednej zaznamenanej vzorky
+unsigned short sim_tbcl1 = 0;        // TBCL1, dlzka impulzu PWM v aktualnej periode
+int sim_awake;                       // obsluha prerusenia zobudila CPU
+
+char **sim_cmds;                     // prikazy terminalu z prikazoveho riadku
+int sim_cmd_count, sim_cmd = 0;
+unsigned short sim_song_ram[SIM_SONG_RAM_WORDS]; // pamat skladieb v FPGA
+unsigned int sim_song_ptr = 0;
+FILE *sim_file = NULL;               // subor posielany po riadkoch (argument @subor)
+int sim_xoff = 0;                    // firmware poslal XOFF, terminal neposiela dalsie riadky
+int sim_started = 0;
+unsigned int sim_max_ticks = SIM_MAX_TICKS;
+int sim_quiet = 0;                   // nevypisuje sa displej ani prikazy (pocas merania)
+unsigned short sim_key_fifo[SIM_KEY_FIFO_SIZE]; // FIFO udalosti klavesnice v FPGA
+unsigned int sim_key_head = 0, sim_key_tail = 0;
+
+const char *bench_names[BENCH_PATHS] = {"klavesnica", "terminal", "sekvencer"};
+const char *bench_cmds[BENCH_PATHS] = {NULL, "C4", "PLAY C4/16"};
+unsigned int bench_lat[BENCH_PATHS][2][BENCH_MAX]; // oneskorenia v tikoch ACLK, [cesta][zvuk zapnuty]
+unsigned int bench_count[BENCH_PATHS][2];
+int sim_bench = 0;                   // prebieha meranie oneskorenia
+int bench_total, bench_n = 0;        // pocet zadanych tonov celkom a doteraz
+int bench_state = BENCH_IDLE;
+int bench_path, bench_warm;          // cesta a stav zvuku pri prave meranom tone
+unsigned int bench_at;               // cas zadania tonu
+unsigned int bench_stamp;            // zaciatok merania (zadanie tonu alebo krok sekvencera)
+unsigned int bench_release = 0;      // cas uvolnenia klavesy (0 = klavesa nie je drzana)
+const char *bench_cmd = NULL;        // riadok terminalu na odoslanie
+unsigned int bench_seed = 1;
+
+FILE *sim_wav;
+unsigned int sim_samples = 0;
+unsigned int sim_rate = 0;
+clock_t sim_clock;
+
+char sim_lcd[LCD_LINES][LCD_CHARS];  // znakova pamat displeja v FPGA (fpga/lcd_fb.vhd)
+int sim_lcd_pos, sim_lcd_changed;
+
+// Zapis cisla do WAV suboru (little endian)
+void sim_put(unsigned int value, int bytes)
+{
+    while (bytes--)
+    {
+        fputc(value & 0xFF, sim_wav);
+        value >>= 8;
+    }
+}
+
+// Hlavicka WAV suboru (16-bitove mono PCM), velkosti sa doplnia na konci simulacie
+void sim_wav_header(void)
+{
+    fwrite("RIFF", 1, 4, sim_wav);
+    sim_put(36 + sim_samples * 2, 4);
+    fwrite("WAVEfmt ", 1, 8, sim_wav);
+    sim_put(16, 4);
+    sim_put(1, 2);              // PCM
+    sim_put(1, 2);              // mono
+    sim_put(sim_rate, 4);
+    sim_put(sim_rate * 2, 4);
+    sim_put(2, 2);
+    sim_put(16, 2);
+    fwrite("data", 1, 4, sim_wav);
+    sim_put(sim_samples * 2, 4);
+}
+
+// Jeden prenos DMA kanala 0 (spustany TBCCR2)
+void sim_dma(void)
+{
+    if (DMA0CTL & DMAEN)
+    {
+        if (sim_dma_n == 0)
+        {
+            sim_dma_src = (unsigned int *)DMA0SA;
+        }
+        if (DMA0DA == (uintptr_t)&TBCCR1)
+        {
+            TBCCR1 = sim_dma_src[sim_dma_n];
+        }
+        else
+        {
+            DAC12_0DAT = sim_dma_src[sim_dma_n];
+        }
+        if (++sim_dma_n >= DMA0SZ) // po DMA0SZ prenosoch sa kanal zakaze a nastavi DMAIFG
+        {
+            sim_dma_n = 0;
+            DMA0CTL = (DMA0CTL & ~DMAEN) | DMAIFG;
+            if (DMA0CTL & DMAIE)
+            {
+                Audio_DMA();
+            }
+        }
+    }
+}
+
+/**
+ * Zvukovy vystup v rozsahu DA prevodnika: PWM na TB1 (P4.1) ako stredna hodnota za periodu,
+ * inak DA prevodnik, vypnuty prevodnik (DAC12AMP = 0) ma na vystupe 0 V.
+ */
+unsigned int sim_dac(void)
+{
+    unsigned int period = TBCCR0 + 1;
+
+    if ((P4SEL & BIT1) && ((TBCCTL1 & OUTMOD_7) == OUTMOD_7))
+    {
+        return (sim_tbcl1 >= period) ? 0x0FFF : sim_tbcl1 * 0x1000 / period;
+    }
+    return (DAC12_0CTL & 0x00E0) ? (DAC12_0DAT & 0x0FFF) : 0;
+}
+
+/**
+ * Zapis vzorky vystupu do WAV suboru. Vzorkuje sa s periodou casovaca B z jeho prveho spustenia
+ * aj v case, ked firmware v tichu casovac B zastavi.
+ */
+void sim_sample(void)
+{
+    if (sim_rate == 0)
+    {
+        if (!(TBCTL & MC_1))
+        {
+            return;
+        }
+        sim_period = TBCCR0 + 1;
+        sim_tb_clock = (TBCTL & TBSSEL_2) ? SIM_SMCLK_PER_ACLK : 1;
+        sim_rate = ACLK_HZ * sim_tb_clock / sim_period;
+    }
+    for (sim_phase += sim_tb_clock; sim_phase >= sim_period; sim_phase -= sim_period)
+    {
+        sim_put((unsigned short)(((int)sim_dac() - 0x0800) * 16), 2);
+        sim_samples++;
+    }
+}
+
+void sim_finish(void);
+
+// Udalost klavesnice (novy stav klaves) do FIFO v FPGA, prazdne FIFO vyvola hranu IRQ
+void sim_key(unsigned short keys)
+{
+    int empty = (sim_key_head == sim_key_tail);
+
+    sim_key_fifo[sim_key_tail] = keys;
+    sim_key_tail = (sim_key_tail + 1) % SIM_KEY_FIFO_SIZE;
+    P1IN |= SIM_KEY_IRQ_PIN;
+    if (empty && (P1IE & SIM_KEY_IRQ_PIN))
+    {
+        P1IFG |= SIM_KEY_IRQ_PIN;
+        Key_IRQ();
+    }
+}
+
+// Opakovatelna pseudonahodna postupnost (rovnake casy zadania pri kazdom spusteni)
+unsigned int bench_rand(unsigned int range)
+{
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return ((bench_seed >> 16) & 0x7FFF) % range;
+}
+
+int bench_compare(const void *a, const void *b)
+{
+    return (int)*(const unsigned int *)a - (int)*(const unsigned int *)b;
+}
+
+// Percentil pct (nearest rank) zoradenych oneskoreni v us
+double bench_percentile(const unsigned int *lat, unsigned int n, unsigned int pct)
+{
+    return lat[(n * pct + 99) / 100 - 1] * 1e6 / ACLK_HZ;
+}
+
+void bench_report(void)
+{
+    int path, warm;
+    unsigned int n;
+    unsigned int *lat;
+
+    printf("Oneskorenie od zadania tonu po prvu nenulovu vzorku DAC:\n");
+    printf("%-11s %-8s %8s %8s %8s %6s\n", "cesta", "zvuk", "p50 us", "p99 us", "max us", "pocet");
+    for (path = 0; path < BENCH_PATHS; path++)
+    {
+        for (warm = 1; warm >= 0; warm--)
+        {
+            n = bench_count[path][warm];
+            lat = bench_lat[path][warm];
+            if (n == 0)
+            {
+                continue;
+            }
+            qsort(lat, n, sizeof(lat[0]), bench_compare);
+            printf("%-11s %-8s %8.0f %8.0f %8.0f %6u\n", bench_names[path], warm ? "zapnuty" : "z ticha",
+                   bench_percentile(lat, n, 50), bench_percentile(lat, n, 99), bench_percentile(lat, n, 100), n);
+        }
+    }
+}
+
+/**
+ * Krok merania oneskorenia v kazdom tiku ACLK. Meria sa az od spustenia hlavnej slucky firmware
+ * (po kalibracii hodin), ton sa zada az v tichu po dozneni predchadzajuceho: v parnych kolach hned
+ * (zvuk este nie je vypnuty), v neparnych az po vypnuti zvuku firmware. Krok sekvencera pride
+ * vzdy az po vypnuti zvuku, aj v parnych kolach sa zaradi medzi tony z ticha.
+ */
+void bench_tick(void)
+{
+    if (bench_release && (sim_ticks == bench_release))
+    {
+        sim_key(0);
+        bench_release = 0;
+    }
+
+    switch (bench_state)
+    {
+        case BENCH_IDLE:
+            if (bench_n == bench_total)
+            {
+                bench_report();
+                sim_bench = 0;
+                sim_quiet = 0;
+                return;
+            }
+            bench_path = bench_n % BENCH_PATHS;
+            bench_warm = !((bench_n / BENCH_PATHS) & 1);
+            if (!sim_started || bench_release || bench_cmd || seq_state || (sim_silent < BENCH_QUIET) ||
+                (!bench_warm && audio_on))
+            {
+                return;
+            }
+            bench_at = sim_ticks + 1 + bench_rand(bench_warm ? BENCH_WARM_SPREAD : BENCH_COLD_SPREAD);
+            bench_state = BENCH_ARMED;
+            break;
+
+        case BENCH_ARMED:
+            if (sim_ticks != bench_at)
+            {
+                return;
+            }
+            bench_warm = audio_on; // zaradi sa podla stavu zvuku od zaciatku merania po zaznenie tonu
+            bench_stamp = sim_ticks;
+            if (bench_path == BENCH_KEYBOARD)
+            {
+                sim_key(0x0001); // KEY_1 = C4
+            }
+            else
+            {
+                bench_cmd = bench_cmds[bench_path]; // odosle terminal_idle
+            }
+            bench_state = BENCH_WAIT;
+            break;
+
+        case BENCH_WAIT:
+            if (!audio_on)
+            {
+                bench_warm = 0;
+            }
+            if (sim_dac() != 0)
+            {
+                bench_lat[bench_path][bench_warm][bench_count[bench_path][bench_warm]++] = sim_ticks - bench_stamp;
+                if (bench_path == BENCH_KEYBOARD)
+                {
+                    bench_release = sim_ticks + BENCH_KEY_HOLD;
+                }
+                bench_n++;
+                bench_state = BENCH_IDLE;
+            }
+            else if (sim_ticks - bench_at > BENCH_TIMEOUT)
+            {
+                printf("Ton (%s) sa nezacal do 1 s od zadania (pri -DAUDIO_NCO DA prevodnik nehra)\n",
+                       bench_names[bench_path]);
+                sim_finish();
+            }
+            break;
+    }
+}
+
+// Jeden tik ACLK: casovac A (nepretrzity rezim) a casovac B (rezim UP)
+void sim_tick(void)
+{
+    unsigned int n;
+
+    if (TACTL & TACLR)
+    {
+        TAR = 0;
+        TACTL &= ~TACLR;
+    }
+    if ((TACTL & MC_2) && (TACTL & TASSEL_2))
+    {
+        // zo SMCLK sa casovac A pouziva iba na meranie SMCLK, nabezna hrana ACLK zachyti TAR do CCR2
+        TAR += SIM_SMCLK_PER_ACLK;
+        if (CCTL2 & CAP)
+        {
+            CCR2 = TAR;
+            CCTL2 |= CCIFG;
+        }
+    }
+    else if (TACTL & MC_2)
+    {
+        TAR++;
+        if ((CCTL1 & CCIE) && (TAR == CCR1))
+        {
+            if (sim_bench && (bench_state == BENCH_WAIT) && (bench_path == BENCH_SEQUENCER))
+            {
+                bench_stamp = sim_ticks; // ton skladby sa meria od kroku sekvencera, ktory ho zacal
+                bench_warm = audio_on;
+            }
+            TAIV = 2;
+            Timer_A1();
+        }
+        if ((CCTL2 & CCIE) && (TAR == CCR2))
+        {
+            TAIV = 4;
+            Timer_A1();
+        }
+    }
+
+    if (TBCTL & TBCLR)
+    {
+        TBR = 0;
+        TBCTL &= ~TBCLR;
+    }
+    for (n = (TBCTL & MC_1) ? ((TBCTL & TBSSEL_2) ? SIM_SMCLK_PER_ACLK : 1) : 0; n; n--)
+    {
+        if (TBR == TBCCR2)
+        {
+            sim_dma();
+        }
+        TBR = (TBR >= TBCCR0) ? 0 : TBR + 1;
+        if ((TBR == 0) && (TBCCTL1 & CLLD_1))
+        {
+            sim_tbcl1 = TBCCR1;
+        }
+    }
+
+    sim_sample();
+    sim_silent = (sim_dac() == 0) ? sim_silent + 1 : 0;
+    if (sim_bench)
+    {
+        bench_tick();
+    }
+    sim_ticks++;
+}
+
+void sim_run(unsigned int ticks)
+{
+    while (ticks--)
+    {
+        sim_tick();
+    }
+}
+
+// Ukoncenie simulacie: doplnenie hlavicky WAV suboru a vypis trvania
+void sim_finish(void)
+{
+    double wall = (double)(clock() - sim_clock) / CLOCKS_PER_SEC;
+
+    fseek(sim_wav, 0, SEEK_SET);
+    sim_wav_header();
+    fclose(sim_wav);
+
+    printf("Simulovany cas %.3f s (%u vzoriek, %u Hz), vypocet %.3f s\n",
+           (double)sim_ticks / ACLK_HZ, sim_samples, sim_rate, wall);
+    exit(0);
+}
+
+// Vypis displeja pri zmene obsahu
+void sim_lcd_show(void)
+{
+    if (!sim_lcd_changed || sim_quiet)
+    {
+        return;
+    }
+    sim_lcd_changed = 0;
+    printf("[%8.3f s] LCD |%.16s|%.16s|\n", (double)sim_ticks / ACLK_HZ, sim_lcd[0], sim_lcd[1]);
+}
+
+// Vykonanie prikazu terminalu tak, ako ho odovzdava kniznica FITkit
+void sim_command(const char *cmd)
+{
+    char orig[SIM_CMD_LEN], ucase[SIM_CMD_LEN];
+    int i;
+
+    strncpy(orig, cmd, SIM_CMD_LEN - 1);
+    orig[SIM_CMD_LEN - 1] = 0;
+    for (i = 0; orig[i]; i++)
+    {
+        ucase[i] = toupper((unsigned char)orig[i]);
+    }
+    ucase[i] = 0;
+    sim_silent = 0; // ticho sa meria od posledneho prikazu, firmware ho moze spracovat az v dalsej ulohe
+
+    if (!sim_quiet)
+    {
+        printf("[%8.3f s] > %s\n", (double)sim_ticks / ACLK_HZ, orig);
+    }
+    if (strcmp(ucase, "HELP") == 0)
+    {
+        print_user_help();
+    }
+    else if (decode_user_cmd(ucase, orig) == CMD_UNKNOWN)
+    {
+        printf("Neznamy prikaz\n");
+    }
+}
+
+// Poslanie dalsieho riadku terminalu: riadok suboru @subor alebo dalsi argument
+void sim_next_command(void)
+{
+    char line[SIM_CMD_LEN];
+
+    while (sim_file || (sim_cmd < sim_cmd_count))
+    {
+        if (sim_file == NULL)
+        {
+            if (sim_cmds[sim_cmd][0] != '@')
+            {
+                sim_command(sim_cmds[sim_cmd++]);
+                return;
+            }
+            sim_file = fopen(sim_cmds[sim_cmd] + 1, "r");
+            if (sim_file == NULL)
+            {
+                perror(sim_cmds[sim_cmd] + 1);
+                exit(1);
+            }
+            sim_cmd++;
+        }
+        if (fgets(line, sizeof(line), sim_file))
+        {
+            line[strcspn(line, "\r\n")] = 0;
+            sim_command(line);
+            return;
+        }
+        fclose(sim_file);
+        sim_file = NULL;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static char *demo[] = {"DEMO"};
+
+    if ((argc >= 3) && (strcmp(argv[1], "-l") == 0))
+    {
+        bench_total = atoi(argv[2]);
+        if ((bench_total < 1) || (bench_total > BENCH_MAX))
+        {
+            fprintf(stderr, "Pocet merani musi byt 1 az %d\n", BENCH_MAX);
+            return 1;
+        }
+        bench_total *= BENCH_PATHS;
+        sim_max_ticks += bench_total * BENCH_TIMEOUT;
+        sim_bench = 1;
+        sim_quiet = 1;
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc < 2)
+    {
+        fprintf(stderr, "Pouzitie: %s [-l pocet] vystup.wav [prikaz terminalu ...]\n", argv[0]);
+        return 1;
+    }
+
+    sim_wav = fopen(argv[1], "wb");
+    if (sim_wav == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    sim_wav_header();
+
+    memset(sim_lcd, ' ', sizeof(sim_lcd));
+    sim_cmds = (argc > 2) ? argv + 2 : demo;
+    sim_cmd_count = (argc > 2) ? argc - 2 : (sim_bench ? 0 : 1);
+    sim_clock = clock();
+
+    fw_main(); // nekonci, simulaciu ukonci terminal_idle()
+    return 0;
+}
+
+/*******************************************************************************
+   Kniznica FITkit
+*******************************************************************************/
+
+// kniznica FITkit nastavi MCLK a SMCLK z krystalu XT2
+void initialize_hardware(void)
+{
+    BCSCTL2 = SELM_2 + SELS;
+}
+
+void WDG_stop(void) {}
+void eint(void) {}
+void dint(void) {}
+
+void _BIS_SR(unsigned int bits)
+{
+    if (!(bits & CPUOFF))
+    {
+        return;
+    }
+    for (sim_awake = 0; !sim_awake; )
+    {
+        sim_tick();
+        if (sim_ticks >= sim_max_ticks)
+        {
+            printf("Prekroceny najdlhsi simulovany cas\n");
+            sim_finish();
+        }
+    }
+}
+
+void _BIC_SR_IRQ(unsigned int bits)
+{
+    if (bits & CPUOFF)
+    {
+        sim_awake = 1;
+    }
+}
+
+void nop(void)
+{
+    sim_tick();
+}
+
+void delay_ms(unsigned int ms)
+{
+    sim_run(ms * ACLK_HZ / 1000);
+}
+
+/**
+ * Hlavna slucka firmware: pri prvom volani sa inicializuje displej (ako po konfiguracii FPGA),
+ * potom sa postupne vykonaju prikazy a simuluje sa dalsi usek casu. Simulacia skonci,
+ * ked sa vykonaju vsetky prikazy, skladba skonci a vystup utichne.
+ */
+void terminal_idle(void)
+{
+    if (!sim_started)
+    {
+        sim_started = 1;
+        fpga_initialized();
+    }
+    if (bench_cmd)
+    {
+        sim_command(bench_cmd);
+        bench_cmd = NULL;
+    }
+    else if (!sim_xoff && !sim_bench)
+    {
+        sim_next_command();
+    }
+
+    sim_run(SIM_STEP);
+    sim_lcd_show();
+
+    if (!sim_bench && (sim_cmd == sim_cmd_count) && (sim_file == NULL) && (seq_state == 0) && (sim_silent >= SIM_TAIL))
+    {
+        sim_finish();
+    }
+    if (sim_ticks >= sim_max_ticks)
+    {
+        printf("Prekroceny najdlhsi simulovany cas\n");
+        sim_finish();
+    }
+}
+
+// Znaky XON a XOFF riadia posielanie riadkov, ostatne sa vypisu
+void term_send_str(char *s)
+{
+    for (; *s; s++)
+    {
+        if ((*s == 0x11) || (*s == 0x13))
+        {
+            sim_xoff = (*s == 0x13);
+            printf("[%8.3f s] < %s\n", (double)sim_ticks / ACLK_HZ, sim_xoff ? "XOFF" : "XON");
+        }
+        else
+        {
+            putchar(*s);
+        }
+    }
+}
+
+void term_send_str_crlf(char *s)
+{
+    puts(s);
+}
+
+void term_send_crlf(void)
+{
+    putchar('\n');
+}
+
+void term_send_num(long n)
+{
+    printf("%ld", n);
+}
+
+int strcmp2(char *s1, char *s2)
+{
+    return (s1[0] == s2[0]) && (s1[1] == s2[1]);
+}
+
+int strcmp4(char *s1, char *s2)
+{
+    return strncmp(s1, s2, 4) == 0;
+}
+
+/**
+ * FPGA: simuluje sa znakova pamat displeja (fpga/lcd_fb.vhd), FIFO klavesnice a pamat skladieb
+ * (fpga/song_ram.vhd), ostatne adresy citaju 0. Slovo sa prenasa vyssim bajtom napred.
+ */
+unsigned int sim_fpga_rw(unsigned char mode, unsigned char addr, unsigned int data)
+{
+    unsigned int out = 0;
+
+    if ((addr == SIM_LCD_FB_POS) && (mode & SPI_FPGA_ENABLE_WRITE))
+    {
+        sim_lcd_pos = data % (LCD_LINES * LCD_CHARS);
+    }
+    else if ((addr >= SIM_LCD_FB_DATA) && (addr <= SIM_LCD_FB_END) && (mode & SPI_FPGA_ENABLE_WRITE))
+    {
+        ((char *)sim_lcd)[sim_lcd_pos] = data >> 8;
+        ((char *)sim_lcd)[(sim_lcd_pos + 1) % (LCD_LINES * LCD_CHARS)] = data & 0xFF;
+        sim_lcd_pos = (sim_lcd_pos + 2) % (LCD_LINES * LCD_CHARS);
+        sim_lcd_changed = 1;
+    }
+    else if ((addr == SIM_KEY_FIFO) && (sim_key_head != sim_key_tail))
+    {
+        out = sim_key_fifo[sim_key_head];
+        sim_key_head = (sim_key_head + 1) % SIM_KEY_FIFO_SIZE;
+        if (sim_key_head == sim_key_tail)
+        {
+            P1IN &= ~SIM_KEY_IRQ_PIN;
+        }
+    }
+    else if (addr == SIM_SONG_RAM_PTR)
+    {
+        out = sim_song_ptr;
+        if (mode & SPI_FPGA_ENABLE_WRITE)
+        {
+            sim_song_ptr = data % SIM_SONG_RAM_WORDS;
+        }
+    }
+    else if ((addr >= SIM_SONG_RAM_DATA) && (addr <= SIM_SONG_RAM_END))
+    {
+        out = sim_song_ram[sim_song_ptr];
+        if (mode & SPI_FPGA_ENABLE_WRITE)
+        {
+            sim_song_ram[sim_song_ptr] = data;
+        }
+        sim_song_ptr = (sim_song_ptr + 1) % SIM_SONG_RAM_WORDS;
+    }
+    return out;
+}
+
+unsigned int FPGA_SPI_RW_A8_D16(unsigned char mode, unsigned char addr, unsigned int data)
+{
+    return sim_fpga_rw(mode, addr, data);
+}
+
+/**
+ * Blokovy prenos: za adresou nasleduje dataw / 2 slov pri jednom vybere FPGA. Zdroj SPI_adc nie je
+ * v projekte, simulator preto predpoklada horsi pripad, ze SPI_adc adresu po kazdom slove zvysi;
+ * prenos, ktory by opustil okno registra v FPGA, sa tak prejavi aj v simulacii.
+ */
+void FPGA_SPI_RW_AN_DN(unsigned char mode, unsigned long addr, unsigned char *data, unsigned char addrw, unsigned int dataw)
+{
+    unsigned int i, word;
+
+    (void)addrw; // simulator dostava adresu hodnotou, jej sirka v bitoch SPI je nepodstatna
+    for (i = 0; i + 1 < dataw; i += 2)
+    {
+        word = sim_fpga_rw(mode, addr + i / 2, (data[i] << 8) | data[i + 1]);
+        if (mode & SPI_FPGA_ENABLE_READ)
+        {
+            data[i] = word >> 8;
+            data[i + 1] = word & 0xFF;
+        }
+    }
+}
+
+unsigned int read_word_keyboard_4x4(void)
+{
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*******************************************************************************
+   wavegen.c: generator tabuliek vzoriek nastrojov pre mcu/wavetable.h
+
+   Pre kazdy nastroj a kazdu oktavu C0 az B7 vypocita jednu periodu signalu
+   WAVE_SAMPLES 8-bitovych vzoriek ako sucet harmonickych so zadanymi
+   amplitudami. Do tabulky oktavy sa zaradia iba harmonicke, ktorych
+   frekvencia pre najvyssi ton oktavy (B) je pod Nyquistovou frekvenciou
+   WAVE_RATE / 2, a najviac WAVE_SAMPLES / 2 - 1 harmonickych, ktore tabulka
+   este zobrazi. Tabulky su generovane pre vzorkovanie 8192 Hz, pri vyssej
+   vzorkovacej frekvencii (-DAUDIO_SMCLK) maju rezervu.
+
+   Preklad a vygenerovanie (z korenoveho adresara projektu):
+     gcc -O2 sim/wavegen.c -o sim/wavegen -lm
+     sim/wavegen > mcu/wavetable.h
+*******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+
+#define WAVE_SAMPLES 32 // musi suhlasit s mcu/main.c
+#define WAVE_OCTAVES 8  // oktavy 0 az 7 (NOTE_FIRST az NOTE_LAST)
+#define WAVE_RATE 8192.0
+#define HARMONICS (WAVE_SAMPLES / 2 - 1)
+
+typedef struct {
+    const char *name;           // nazov tabulky v C
+    const char *comment;        // popis zvuku
+    double amp[HARMONICS];      // amplitudy harmonickych 1, 2, 3, ...
+} timbre_t;
+
+const timbre_t timbres[] = {
+    // neparne harmonicke s rychlejsim poklesom nez obdlznik, parne takmer chybaju
+    {"wave_clarinet", "klarinet: prevazuju neparne harmonicke",
+     {1.0, 0.02, 0.55, 0.02, 0.30, 0.02, 0.16, 0.01, 0.09, 0.01, 0.05, 0.0, 0.03, 0.0, 0.02}},
+    // silna zakladna frekvencia a slabe nizke harmonicke
+    {"wave_flute", "flauta: takmer sinus so slabymi nizkymi harmonickymi",
+     {1.0, 0.22, 0.08, 0.03, 0.01}},
+    // tahy organu 8', 4', 2 2/3', 2'
+    {"wave_organ", "organ: harmonicke 1, 2, 3, 4 a 8",
+     {1.0, 0.6, 0.4, 0.3, 0.0, 0.0, 0.0, 0.15}},
+    // obdlznik 4/pi * sum(sin(k x) / k) pre neparne k
+    {"wave_square", "obdlznik: neparne harmonicke s amplitudou 1/k",
+     {1.0, 0.0, 1.0 / 3, 0.0, 1.0 / 5, 0.0, 1.0 / 7, 0.0, 1.0 / 9, 0.0, 1.0 / 11, 0.0, 1.0 / 13, 0.0, 1.0 / 15}}
+};
+
+#define TIMBRES (sizeof(timbres) / sizeof(timbres[0]))
+
+// Frekvencia najvyssieho tonu oktavy (B), A4 = 440 Hz
+double octave_top(int octave)
+{
+    int midi = (octave + 1) * 12 + 11;
+
+    return 440.0 * pow(2.0, (midi - 69) / 12.0);
+}
+
+// Jedna perioda signalu s harmonickymi pod Nyquistovou frekvenciou, normovana na rozsah 0 az 255
+void make_wave(const timbre_t *t, int octave, unsigned char *out)
+{
+    double x[WAVE_SAMPLES], peak = 0.0;
+    double top = octave_top(octave);
+    int n, k;
+
+    for (n = 0; n < WAVE_SAMPLES; n++)
+    {
+        x[n] = 0.0;
+        for (k = 1; (k <= HARMONICS) && (k * top < WAVE_RATE / 2); k++)
+        {
+            x[n] += t->amp[k - 1] * sin(2.0 * M_PI * k * n / WAVE_SAMPLES);
+        }
+        if (fabs(x[n]) > peak)
+        {
+            peak = fabs(x[n]);
+        }
+    }
+    for (n = 0; n < WAVE_SAMPLES; n++)
+    {
+        out[n] = (unsigned char)lround(127.5 + 127.5 * x[n] / peak);
+    }
+}
+
+int main(void)
+{
+    unsigned char wave[WAVE_SAMPLES];
+    unsigned int i;
+    int octave, n;
+
+    printf("/**\n");
+    printf(" * @file wavetable.h\n");
+    printf(" * Tabulky vzoriek nastrojov, jedna perioda po %d vzorkach pre kazdu oktavu 0 az 7.\n", WAVE_SAMPLES);
+    printf(" * Vygenerovane programom sim/wavegen.c, subor needitovat rucne.\n");
+    printf(" */\n\n");
+    printf("#ifndef _WAVETABLE_H_\n#define _WAVETABLE_H_\n");
+
+    for (i = 0; i < TIMBRES; i++)
+    {
+        printf("\n// %s\n", timbres[i].comment);
+        printf("const unsigned char %s[%d][%d] = {\n", timbres[i].name, WAVE_OCTAVES, WAVE_SAMPLES);
+        for (octave = 0; octave < WAVE_OCTAVES; octave++)
+        {
+            make_wave(&timbres[i], octave, wave);
+            printf("    {");
+            for (n = 0; n < WAVE_SAMPLES; n++)
+            {
+                printf("%s%3d", n ? "," : "", wave[n]);
+            }
+            printf("}%s // oktava %d\n", (octave < WAVE_OCTAVES - 1) ? "," : "", octave);
+        }
+        printf("};\n");
+    }
+
+    printf("\n#endif\n");
+    return 0;
+}